@@ -1,8 +1,47 @@
+#if defined(__linux__)
+#define _GNU_SOURCE // O_DIRECT
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
+#include <stddef.h> // offsetof
+#include <time.h>
+#include <errno.h>
 // #include <ctype.h> // Removed as requested
 
+// --- Platform Support ---
+// Worker threads are used for batch jobs where pthreads are available.
+// Builds without them (e.g. plain MinGW on Windows) run the same jobs serially.
+#ifdef _WIN32
+#include <direct.h>  // _mkdir
+#include <windows.h> // GetTickCount64
+#else
+#include <pthread.h>
+#include <unistd.h>   // sysconf, pread, pwrite
+#include <fcntl.h>    // open, O_DIRECT
+#include <sys/stat.h> // mkdir, fstat
+#include <sys/socket.h> // Change stream socket
+#include <sys/un.h>
+#include <signal.h>
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // Not available everywhere (e.g. macOS, which has SO_NOSIGPIPE)
+#ifndef SO_NOSIGPIPE
+#define CDC_IGNORE_SIGPIPE 1 // Neither: ignore SIGPIPE so a closed listener cannot kill the process
+#endif
+#endif
+#define HAVE_THREADS 1
+// Batched table I/O uses io_uring where the kernel headers provide it
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>    // Ring buffers are shared with the kernel via mmap
+#include <sys/syscall.h> // io_uring_setup, io_uring_enter (no liburing needed)
+#define HAVE_IO_URING 1
+#endif
+#endif
+#endif
+
 // --- Constants ---
 #define MAX_PATIENTS 100
 #define MAX_DOCTORS 50
@@ -16,6 +55,52 @@
 #define AVAILABILITY_LEN 50
 #define DATE_LEN 11 // YYYY-MM-DD
 #define TIME_LEN 6  // HH:MM
+#define PATH_LEN 260
+#define MAX_WORKERS 16
+#define MAX_BRANCHES 16
+#define BRANCH_ID_STRIDE 1000000 // IDs of branch b are b * BRANCH_ID_STRIDE + 1, + 2, ...
+#define SLOT_MINUTES 30                          // Length of one bookable slot
+#define SLOTS_PER_DAY (24 * 60 / SLOT_MINUTES)   // 48 slots: one day fits in a 64-bit word
+#define CALENDAR_DAYS 64                         // Days of bookings kept in the slot calendar
+#define MAX_FREE_SLOTS 100                       // Most results one slot search returns
+#define LOG_COMPACT_RECORDS 1000                 // Rewrite the change log on save past this size
+#define MAX_HISTORY_VERSIONS 4096                // Patient versions kept across all patients
+#define HISTORY_DATA_SIZE (256 * 1024)           // Bytes of encoded version payloads
+#define HISTORY_HEAD_SLOTS (2 * MAX_HISTORY_VERSIONS) // Patient ID -> newest version; a power of two with a slot per chain
+#define HISTORY_FULL_EVERY 8                     // A full image at least every N versions
+#define HISTORY_DEFAULT_RETENTION_DAYS 365       // Used when the history store fills up
+#define NAME_INDEX_TOKENS 4                      // Index the full name plus up to 3 of its words
+#define NAME_INDEX_NODES (MAX_PATIENTS * NAME_INDEX_TOKENS * 2) // Room for deleted nodes too
+#define NAME_SEARCH_RESULTS 5                    // Matches shown when picking a patient
+#define AGGREGATE_SLOTS 1024                     // Hash slots per dashboard aggregate table
+#define DATE_INDEX_FANOUT 16                     // Most keys in one date index node
+#define DATE_INDEX_FILL 12                       // Keys per node when the date index is rebuilt
+#define DATE_INDEX_NODES (MAX_APPOINTMENTS / 4 + 16) // Nodes in the date index pool
+#define DATE_PAGE_SIZE 10                        // Appointments per page of a date listing
+#define MVCC_CHUNK_VERSIONS 256                  // Record versions per version store chunk
+#define MVCC_MAX_CHUNKS 64                       // Chunks per table (never moved once allocated)
+#define MVCC_MAX_SNAPSHOTS 64                    // Snapshots open at once, per branch
+#define MVCC_GC_EVERY 32                         // Commits between collections of old versions
+#define MVCC_NEVER 0x7fffffffffffffffLL          // Sequence of "not yet" / "not ended"
+#define MVCC_HEAD_SLOTS 512                      // Hash slots for record ID -> newest version (> 2 x largest table)
+#define IO_ALIGN 4096                            // Buffer and block alignment for table I/O
+#define MAX_TABLE_FILES 8                        // Most files loaded or saved in one batch
+#define IO_DIRECT 1                              // ioFlags: bypass the page cache (O_DIRECT)
+#define IO_NO_URING 2                            // ioFlags: use worker threads instead of io_uring
+#define TRIAGE_HEAP_ARITY 4                      // Children per node of a triage queue heap
+#define MAX_WAITING MAX_PATIENTS                 // Walk-ins one doctor's queue can hold
+#define WAITING_INDEX_SLOTS 256                  // Hash slots for waiting patients (> MAX_PATIENTS)
+#define TRIAGE_LEVEL_IMMEDIATE 1                 // Most urgent triage level
+#define TRIAGE_LEVEL_LOWEST 5                    // Least urgent triage level
+#define ARCHIVE_BLOCK_RECORDS 16                 // Records per compressed archive block
+#define MAX_ARCHIVE_SEGMENTS 256                 // Archive segments indexed in memory
+#define MAX_ARCHIVE_BLOCKS 4096                  // Sparse index entries across all segments
+#define CDC_RING_SIZE 1024                       // Change events buffered between operator and writer
+#define CDC_BATCH_EVENTS 256                     // Most change events written per write call
+#define CDC_POLL_MS 20                           // Writer's pause when the ring is empty
+#define CDC_CLOSE_TRIES 50                       // Polls to finish a cut socket line at shutdown (1 s)
+#define CDC_TAIL_BYTES 4096                      // Bytes read back to find the last sequence number
+#define CDC_MAX_LINE 2048                        // Longest change event line
 
 // --- File Names ---
 #define PATIENT_FILE "patients.dat"
@@ -23,6 +108,18 @@
 #define APPOINTMENT_FILE "appointments.dat"
 #define BILL_FILE "bills.dat"
 #define COUNTER_FILE "counters.dat" // To store next IDs
+#define STATEMENT_DIR "statements"  // Batch statement output
+#define HOURS_FILE "hours.dat"      // Structured doctor working hours
+#define BRANCH_FILE "branches.cfg"  // Branch list (text): id|name|data directory
+#define CHANGE_LOG_FILE "changes.log" // Change log shipped to read replicas
+#define HISTORY_FILE "history.dat"    // Patient edit history (version chains)
+#define DASHBOARD_FILE "dashboard.txt" // Dashboard dump (text)
+#define TRIAGE_FILE "triage.log"       // Waiting room events (walk-in queues)
+#define ARCHIVE_DIR "archive"          // Cold tier: archived appointments and bills
+#define ARCHIVE_CATALOG_FILE "catalog.dat" // Segments in the archive directory, in order
+#define ARCHIVE_MAGIC "HSEG"
+#define CDC_FILE "cdc.log"             // Change event stream (JSON lines, all branches)
+#define CDC_OFFSET_FILE "cdc.offsets"  // Consumer positions in the change stream
 
 // --- Data Structures (Using struct Name {...}; style) ---
 struct Patient {
@@ -41,6 +138,14 @@ struct Doctor {
     char availability[AVAILABILITY_LEN];
 };
 
+// Structured working hours, kept in a separate file so doctors.dat keeps its layout
+struct DoctorHours {
+    int doctorId;
+    int workDays;    // Bit 0 = Monday ... bit 6 = Sunday
+    int startMinute; // Minutes after midnight
+    int endMinute;   // Exclusive
+};
+
 struct Appointment {
     int id;
     int patientId;
@@ -60,9 +165,219 @@ struct Bill {
     char dateGenerated[DATE_LEN];
 };
 
+// One entry in a patient's version chain. The payload in PatientHistory.data
+// holds only the fields that changed (a delta) or all fields (a full image).
+struct PatientVersion {
+    int patientId;
+    int kind;             // VERSION_FULL, VERSION_DELTA or VERSION_DELETED
+    long long timestamp;  // When the version was made (0 = before history was kept)
+    int previous;         // Older version of the same patient, -1 if none
+    int next;             // Newer version of the same patient, -1 if none
+    int base;             // Full image (or deletion) this version builds on
+    int previousFull;     // Full image before base, -1 if none
+    int offset;           // Payload position in data
+    int length;           // Payload size in bytes
+    int sinceFull;        // Deltas since base (0 for full images)
+};
+
+struct PatientHistory {
+    struct PatientVersion versions[MAX_HISTORY_VERSIONS];
+    int versionCount;
+    unsigned char data[HISTORY_DATA_SIZE];
+    int dataUsed;
+    int headId[HISTORY_HEAD_SLOTS];      // Patient ID in this slot (0 = empty)
+    int headVersion[HISTORY_HEAD_SLOTS]; // Newest version of that patient
+};
+
+// BK-tree over normalized patient names (edit distance). Children are kept as
+// first-child / next-sibling lists, each labelled with its distance to the parent.
+struct NameIndexNode {
+    int patientId;
+    int deleted;        // Removed from the index (skipped, reclaimed on rebuild)
+    int parentDistance; // Edit distance to the parent's key
+    int firstChild;
+    int nextSibling;
+    char key[NAME_LEN];
+};
+
+struct NameIndex {
+    struct NameIndexNode nodes[NAME_INDEX_NODES];
+    int nodeCount;
+    int deletedCount;
+};
+
+// One counter row of a dashboard aggregate, keyed by (keyA, keyB).
+// Money is kept in cents so adding and removing bills never drifts.
+struct AggregateEntry {
+    int inUse;
+    int keyA;
+    int keyB;
+    int counts[2];
+    long long cents;
+};
+
+// Open-addressing hash table of aggregate rows. Rows that drop back to zero
+// stay in place until the table is compacted.
+struct AggregateTable {
+    struct AggregateEntry entries[AGGREGATE_SLOTS];
+    int used;
+};
+
+// Dashboard figures kept up to date by the record mutation helpers. They cover
+// the working tables only: archiving removes records from the counts.
+struct Dashboard {
+    struct AggregateTable doctorDay; // (doctor ID, day): counts[0] = appointments
+    struct AggregateTable day;       // (day, 0): counts[0] = appointments, counts[1] = bills, cents = revenue
+    struct AggregateTable patient;   // (patient ID, 0): counts[0] = appointments + bills, counts[1] = on file
+    int appointments;
+    int bills;
+    long long revenueCents;
+    int patients;
+    int activePatients;              // Patients on file with at least one appointment or bill
+    int untracked;                   // Count updates lost because a table was full
+};
+
+// Position of an appointment in date order. Appointments at the same date,
+// time and doctor are told apart by ID.
+struct DateKey {
+    int day;           // Day number (see parseDate)
+    int minute;        // Minutes after midnight, -1 if the time does not parse
+    int doctorId;
+    int appointmentId;
+};
+
+struct DateEntry {
+    struct DateKey key;
+    int patientId;
+};
+
+// Date index (B+-tree) node. Leaves hold appointments in key order and are
+// chained for range scans; inner nodes route by keys[i] = smallest key under
+// children[i + 1].
+struct DateIndexNode {
+    int leaf;
+    int count;                            // Keys in use
+    int next;                             // Leaves: next leaf in key order, -1 at the end
+    struct DateKey keys[DATE_INDEX_FANOUT];
+    int patientIds[DATE_INDEX_FANOUT];    // Leaves only
+    int children[DATE_INDEX_FANOUT + 1];  // Inner nodes only
+};
+
+struct DateIndex {
+    struct DateIndexNode nodes[DATE_INDEX_NODES];
+    int nodeCount;
+    int root;          // -1 when empty
+    int entryCount;
+    int removedCount;  // Removals since the last rebuild
+};
+
+// One version of a patient, appointment or bill. Visible to snapshots at
+// sequence s with begin <= s < end; unused slots have begin = MVCC_NEVER.
+struct RecordVersion {
+    long long begin;   // Commit sequence that created it
+    long long end;     // Commit sequence that replaced or deleted it, MVCC_NEVER while current
+    int id;
+    int nextFree;      // Free list link (writer only)
+    union {
+        struct Patient patient;
+        struct Appointment appointment;
+        struct Bill bill;
+    } data;
+};
+
+// Versions of one table, in fixed-size chunks so readers never see them move
+struct VersionHead {
+    int id;   // Record ID (0 = empty)
+    int slot; // Its newest version
+};
+
+struct VersionStore {
+    struct RecordVersion* chunks[MVCC_MAX_CHUNKS];
+    int chunkCount;
+    int freeHead;      // First free slot (chunk * MVCC_CHUNK_VERSIONS + index), -1 if none
+    int used;
+    struct VersionHead heads[MVCC_HEAD_SLOTS]; // Only the writer uses these
+};
+
+// A walk-in waiting for a doctor. Lower level first, then earlier arrival.
+struct TriageEntry {
+    int patientId;
+    int level;          // TRIAGE_LEVEL_IMMEDIATE .. TRIAGE_LEVEL_LOWEST
+    long long sequence; // Arrival order
+    long long arrived;  // Arrival time (seconds since the epoch)
+};
+
+struct TriageQueue {
+    struct TriageEntry heap[MAX_WAITING]; // TRIAGE_HEAP_ARITY-ary min-heap
+    int size;
+};
+
+// Where a waiting patient is (patientId 0 = free slot)
+struct WaitingSlot {
+    int patientId;
+    int doctorIndex;
+    int position; // Index in the doctor's heap
+};
+
+// Triage event ops
+#define TRIAGE_ENQUEUE 1
+#define TRIAGE_REPRIORITIZE 2
+#define TRIAGE_CALLED 3
+#define TRIAGE_LEFT 4
+
+// One record of triage.log
+struct TriageEvent {
+    int op;
+    int patientId;
+    int doctorId;       // TRIAGE_ENQUEUE only
+    int level;          // TRIAGE_ENQUEUE, TRIAGE_REPRIORITIZE
+    long long sequence;
+    long long timestamp;
+};
+
+// Start of an archive segment file. The sparse index (one ArchiveBlock per
+// block) is at indexOffset, after the blocks.
+struct ArchiveSegmentHeader {
+    char magic[4];        // ARCHIVE_MAGIC
+    int table;            // TABLE_APPOINTMENT or TABLE_BILL
+    int recordCount;
+    int blockCount;
+    int minId;
+    int maxId;
+    long long createdAt;
+    long long indexOffset;
+};
+
+struct ArchiveBlock {
+    int firstId;
+    int lastId;
+    int count;
+    int length;                     // Encoded bytes
+    long long offset;               // Position in the segment file
+    unsigned long long patientMask; // Bit (patientId % 64) of every patient in the block
+};
+
+// An indexed segment; its blocks are archiveBlocks[firstBlock .. firstBlock + blockCount)
+struct ArchiveSegment {
+    int table;
+    int number;
+    int recordCount;
+    int minId;
+    int maxId;
+    int firstBlock;
+    int blockCount;
+    long long createdAt;
+};
+
 // --- Application State Structure ---
 // Holds all data previously stored in global variables
 struct AppState {
+    // Branch (partition) this state belongs to; its files live in dataDir
+    int branchId;
+    char branchName[NAME_LEN];
+    char dataDir[PATH_LEN];
+    int ioFlags; // IO_DIRECT, IO_NO_URING
+
     struct Patient patients[MAX_PATIENTS];
     int patientCount;
 
@@ -80,8 +395,90 @@ struct AppState {
     int nextDoctorId;
     int nextAppointmentId;
     int nextBillId;
+
+    // Working hours and slot calendar (doctors are never removed, so these stay
+    // parallel to doctors[] by index)
+    struct DoctorHours doctorHours[MAX_DOCTORS];
+    unsigned long long hoursMask[MAX_DOCTORS];  // Slots inside working hours on a work day
+    int calendarStartDay;                       // Day number of bookedSlots[..][0]
+    unsigned long long bookedSlots[MAX_DOCTORS][CALENDAR_DAYS];
+
+    // Change log for read replicas (NULL on replicas and until opened)
+    FILE* changeLog;
+    long long lastLsn;          // LSN of the last change logged (primary) or applied (replica)
+    long long checkpointLsn;    // LSN covered by the saved .dat files
+    long long logGeneration;    // Identifies the current log file contents
+    int logRecords;             // Records in the current log generation
+
+    // Edit history of patient records
+    struct PatientHistory history;
+
+    // Typo-tolerant patient name lookup
+    struct NameIndex nameIndex;
+
+    // Live dashboard counts (maintained per change, rebuilt at load)
+    struct Dashboard dashboard;
+
+    // Appointments in date and time order
+    struct DateIndex dateIndex;
+
+    // Waiting room: a triage queue per doctor (parallel to doctors[] by index)
+    struct TriageQueue triage[MAX_DOCTORS];
+    struct WaitingSlot waitingIndex[WAITING_INDEX_SLOTS];
+    FILE* triageLog;
+    long long triageSequence;   // Sequence of the last triage event
+    int triageRecords;          // Events in triage.log
+
+    // Cold tier: sparse indexes of the archive segments
+    struct ArchiveSegment archiveSegments[MAX_ARCHIVE_SEGMENTS];
+    int archiveSegmentCount;
+    struct ArchiveBlock archiveBlocks[MAX_ARCHIVE_BLOCKS];
+    int archiveBlockCount;
+    int archiveNextSegment;
+    int archiveCheckpoint;      // Segments numbered below this are reflected in the saved tables
+
+    // Change event stream shared by all branches (NULL when not publishing)
+    struct CdcStream* cdc;
+
+    // Versions for snapshot reads of patients, appointments and bills
+    struct VersionStore patientVersions;
+    struct VersionStore appointmentVersions;
+    struct VersionStore billVersions;
+    long long commitSequence;                // Last committed sequence
+    long long pendingSequence;               // Sequence of the open transaction
+    int transactionDepth;
+    int commitsSinceCollect;
+    long long snapshots[MVCC_MAX_SNAPSHOTS]; // Sequence of each open snapshot (0 = slot free)
+    int forcedCollections;                   // Times versions were dropped while still visible
+};
+
+// A registered read view of one branch (see openSnapshot)
+struct Snapshot {
+    struct AppState* state;
+    long long sequence;
+    int slot;
+    int forcedCollections;
 };
 
+// --- Function Prototypes (for functions used before their definition) ---
+void rebuildSlotCalendar(struct AppState* state, int startDay);
+void resetChangeLog(struct AppState* state);
+void insertPatientRecord(struct AppState* state, struct Patient* p);
+void updatePatientRecord(struct AppState* state, int index, struct Patient* p);
+void removePatientAt(struct AppState* state, int index);
+void insertDoctorRecord(struct AppState* state, struct Doctor* d, struct DoctorHours* hours);
+void updateDoctorHours(struct AppState* state, int index, struct DoctorHours* hours);
+void rebuildHistoryHeads(struct PatientHistory* history);
+void rebuildNameIndex(struct AppState* state);
+void rebuildDashboard(struct AppState* state);
+void rebuildDateIndex(struct AppState* state);
+void resetVersionStores(struct AppState* state);
+void loadTriageLog(struct AppState* state);
+void compactTriageLog(struct AppState* state);
+void removeFromWaitingRoom(struct AppState* state, int patientId);
+void loadArchiveCatalog(struct AppState* state);
+void dropArchivedHotRecords(struct AppState* state);
+
 // --- Utility Functions ---
 
 // Clear input buffer
@@ -98,6 +495,10 @@ void getStringInput(char* prompt, char* buffer, int len) {
         int readLen = strlen(buffer);
         if (readLen > 0 && buffer[readLen - 1] == '\n') {
             buffer[readLen - 1] = '\0';
+        } else if (readLen == len - 1) {
+            // Input filled the buffer: drop the rest of the line so it is not
+            // read as the answer to the next prompt (e.g. "YYYY-MM-DD" in DATE_LEN)
+            clearInputBuffer();
         }
     } else {
         // Handle error or EOF
@@ -156,81 +557,907 @@ float getFloatInput(char* prompt) {
     return value;
 }
 
+// Wall-clock time in milliseconds (for reporting job durations)
+double currentTimeMillis() {
+#ifdef _WIN32
+    return (double)GetTickCount64();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+#endif
+}
+
+// Create a directory if it does not exist yet (errors are reported when files are opened)
+void makeDirectory(char* path) {
+#ifdef _WIN32
+    _mkdir(path);
+#else
+    mkdir(path, 0755);
+#endif
+}
+
+// Move a fully written temporary file over path in one step, so a crash
+// leaves either the old file or the new one. Returns 0 on success.
+int replaceFile(char* tempPath, char* path) {
+#ifdef _WIN32
+    // rename() does not replace existing files on Windows
+    if (MoveFileExA(tempPath, path, MOVEFILE_REPLACE_EXISTING)) return 0;
+    errno = EACCES; // For perror()
+    return -1;
+#else
+    return rename(tempPath, path);
+#endif
+}
+
+// Number of CPU cores, used as the default worker count
+int getCoreCount() {
+#ifdef HAVE_THREADS
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores < 1) return 1;
+    if (cores > MAX_WORKERS) return MAX_WORKERS;
+    return (int)cores;
+#else
+    return 1;
+#endif
+}
+
+// --- Date and Time Helpers ---
+// Dates are handled as day numbers (days since 1970-01-01) so ranges and
+// weekdays are simple arithmetic.
+
+// Day number for a civil date (proleptic Gregorian calendar)
+int daysFromCivil(int year, int month, int day) {
+    year -= month <= 2;
+    int era = (year >= 0 ? year : year - 399) / 400;
+    int yearOfEra = year - era * 400;
+    int dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + dayOfEra - 719468;
+}
+
+// Parse "YYYY-MM-DD" into a day number. Returns -1 if the date is invalid.
+int parseDate(char* text) {
+    int year, month, day;
+    char extra;
+    if (sscanf(text, "%4d-%2d-%2d%c", &year, &month, &day, &extra) != 3) return -1;
+    if (year < 1970 || month < 1 || month > 12 || day < 1) return -1;
+    int daysInMonth[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    int leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    if (day > daysInMonth[month - 1] + (month == 2 && leap)) return -1;
+    return daysFromCivil(year, month, day);
+}
+
+// Format a day number as "YYYY-MM-DD" (out must hold DATE_LEN chars)
+void formatDate(int dayNumber, char* out) {
+    int z = dayNumber + 719468;
+    int era = (z >= 0 ? z : z - 146096) / 146097;
+    int dayOfEra = z - era * 146097;
+    int yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    int dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    int mp = (5 * dayOfYear + 2) / 153;
+    int day = dayOfYear - (153 * mp + 2) / 5 + 1;
+    int month = mp < 10 ? mp + 3 : mp - 9;
+    int year = yearOfEra + era * 400 + (month <= 2);
+    if (snprintf(out, DATE_LEN, "%04d-%02d-%02d", year, month, day) >= DATE_LEN) {
+        snprintf(out, DATE_LEN, "0000-00-00"); // Year outside 0000-9999: not a valid date
+    }
+}
+
+// Parse "HH:MM" into minutes after midnight. Returns -1 if invalid.
+int parseTime(char* text) {
+    int hours, minutes;
+    char extra;
+    if (sscanf(text, "%2d:%2d%c", &hours, &minutes, &extra) != 2) return -1;
+    if (hours < 0 || hours > 23 || minutes < 0 || minutes > 59) return -1;
+    return hours * 60 + minutes;
+}
+
+// Format a minute of the day as "HH:MM" (out must hold TIME_LEN chars);
+// anything outside the day becomes "--:--"
+void formatTime(int minute, char* out) {
+    if (minute < 0 || minute >= 24 * 60) snprintf(out, TIME_LEN, "--:--");
+    else snprintf(out, TIME_LEN, "%02d:%02d", minute / 60, minute % 60);
+}
+
+// 0 = Monday ... 6 = Sunday (1970-01-01 was a Thursday)
+int weekdayOf(int dayNumber) {
+    return ((dayNumber % 7) + 7 + 3) % 7;
+}
+
+// Today's day number and the current minute, in local time
+int todayDayNumber(int* minuteOfDay) {
+    time_t now = time(NULL);
+#ifdef HAVE_THREADS
+    struct tm result;
+    struct tm* local = localtime_r(&now, &result); // Branches load on several threads
+#else
+    struct tm* local = localtime(&now);
+#endif
+    if (minuteOfDay != NULL) *minuteOfDay = local->tm_hour * 60 + local->tm_min;
+    return daysFromCivil(local->tm_year + 1900, local->tm_mon + 1, local->tm_mday);
+}
+
+// Index (0 = Monday) of a three-letter day name at text, case-insensitive; -1 if none
+int parseWeekdayName(char* text) {
+    char* names[] = {"mon", "tue", "wed", "thu", "fri", "sat", "sun"};
+    char lower[4];
+    for (int i = 0; i < 3; i++) {
+        char c = text[i];
+        if (c >= 'A' && c <= 'Z') c = c - 'A' + 'a';
+        lower[i] = c;
+        if (c == '\0') return -1;
+    }
+    lower[3] = '\0';
+    for (int d = 0; d < 7; d++) {
+        if (strcmp(lower, names[d]) == 0) return d;
+    }
+    return -1;
+}
+
+// Parse days such as "Mon-Fri", "Mon,Wed,Fri" or "Sat-Sun,Wed" into a bitmask.
+// Returns -1 if the text cannot be parsed.
+int parseWorkDays(char* text) {
+    int mask = 0;
+    char* p = text;
+    while (*p != '\0') {
+        while (*p == ' ' || *p == ',') p++;
+        if (*p == '\0') break;
+        int first = parseWeekdayName(p);
+        if (first == -1) return -1;
+        p += 3;
+        while (*p != '\0' && *p != '-' && *p != ',' && *p != ' ') p++; // Allow "Monday"
+        int last = first;
+        if (*p == '-') {
+            p++;
+            last = parseWeekdayName(p);
+            if (last == -1) return -1;
+            p += 3;
+            while (*p != '\0' && *p != ',' && *p != ' ') p++;
+        }
+        for (int d = first; ; d = (d + 1) % 7) { // Ranges may wrap, e.g. Sat-Mon
+            mask |= 1 << d;
+            if (d == last) break;
+        }
+    }
+    return mask;
+}
+
+// Index of the lowest set bit (word must be non-zero)
+int lowestSetBit(unsigned long long word) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(word);
+#else
+    int bit = 0;
+    while ((word & 1ULL) == 0) { word >>= 1; bit++; }
+    return bit;
+#endif
+}
+
+// --- Text Buffer ---
+// Growable string used to format output in memory before writing it out.
+
+struct TextBuffer {
+    char* data;
+    size_t length;
+    size_t capacity;
+};
+
+void initTextBuffer(struct TextBuffer* buf) {
+    buf->data = NULL;
+    buf->length = 0;
+    buf->capacity = 0;
+}
+
+void freeTextBuffer(struct TextBuffer* buf) {
+    free(buf->data);
+    initTextBuffer(buf);
+}
+
+// Append printf-style formatted text, growing the buffer as needed.
+// Returns 0 on success, -1 if memory ran out.
+int appendText(struct TextBuffer* buf, char* format, ...) {
+    va_list args;
+    while (1) {
+        size_t room = buf->capacity - buf->length;
+        va_start(args, format);
+        int written = vsnprintf(buf->data ? buf->data + buf->length : NULL, room, format, args);
+        va_end(args);
+        if (written < 0) return -1;
+        if ((size_t)written < room) {
+            buf->length += written;
+            return 0;
+        }
+        // Not enough room: at least double the buffer and try again
+        size_t newCapacity = buf->capacity ? buf->capacity * 2 : 4096;
+        while (newCapacity < buf->length + written + 1) newCapacity *= 2;
+        char* grown = realloc(buf->data, newCapacity);
+        if (grown == NULL) return -1;
+        buf->data = grown;
+        buf->capacity = newCapacity;
+    }
+}
+
+int writeTextFile(char* path, struct TextBuffer* buf) {
+    FILE* fp = fopen(path, "wb"); // Binary mode: identical bytes on every platform
+    if (fp == NULL) {
+        perror("Error opening text file for writing");
+        return -1;
+    }
+    size_t written = fwrite(buf->data, 1, buf->length, fp);
+    if (fclose(fp) != 0 || written != buf->length) {
+        perror("Error writing text file");
+        return -1;
+    }
+    return 0;
+}
+
+// --- Worker Pool ---
+// Runs task(context, taskIndex, workerIndex) for every task index using up to
+// workerCount threads. Workers pull the next task from a shared counter, so
+// uneven tasks still balance out. Without thread support the tasks run in order.
+
+typedef void (*TaskFunction)(void* context, int taskIndex, int workerIndex);
+
+struct WorkerPool {
+    TaskFunction task;
+    void* context;
+    int taskCount;
+    int nextTask;
+#ifdef HAVE_THREADS
+    pthread_mutex_t lock;
+#endif
+};
+
+struct WorkerArgs {
+    struct WorkerPool* pool;
+    int workerIndex;
+};
+
+#ifdef HAVE_THREADS
+void* workerMain(void* arg) {
+    struct WorkerArgs* args = (struct WorkerArgs*)arg;
+    struct WorkerPool* pool = args->pool;
+    while (1) {
+        pthread_mutex_lock(&pool->lock);
+        int taskIndex = pool->nextTask++;
+        pthread_mutex_unlock(&pool->lock);
+        if (taskIndex >= pool->taskCount) break;
+        pool->task(pool->context, taskIndex, args->workerIndex);
+    }
+    return NULL;
+}
+#endif
+
+// Returns the number of workers actually used
+int runWorkerPool(TaskFunction task, void* context, int taskCount, int workerCount) {
+    if (workerCount < 1) workerCount = 1;
+    if (workerCount > MAX_WORKERS) workerCount = MAX_WORKERS;
+    if (workerCount > taskCount) workerCount = taskCount > 0 ? taskCount : 1;
+
+#ifdef HAVE_THREADS
+    if (workerCount > 1) {
+        struct WorkerPool pool;
+        pthread_t threads[MAX_WORKERS];
+        struct WorkerArgs args[MAX_WORKERS];
+        int started = 0;
+
+        pool.task = task;
+        pool.context = context;
+        pool.taskCount = taskCount;
+        pool.nextTask = 0;
+        pthread_mutex_init(&pool.lock, NULL);
+
+        for (int w = 0; w < workerCount; w++) {
+            args[w].pool = &pool;
+            args[w].workerIndex = w;
+            if (pthread_create(&threads[w], NULL, workerMain, &args[w]) != 0) {
+                break; // Remaining tasks are picked up by the threads that did start
+            }
+            started++;
+        }
+        if (started == 0) {
+            // Could not start any thread: do the work on this one
+            args[0].pool = &pool;
+            args[0].workerIndex = 0;
+            workerMain(&args[0]);
+            started = 1;
+        }
+        for (int w = 0; w < started; w++) {
+            pthread_join(threads[w], NULL);
+        }
+        pthread_mutex_destroy(&pool.lock);
+        return started;
+    }
+#endif
+    for (int i = 0; i < taskCount; i++) {
+        task(context, i, 0);
+    }
+    return 1;
+}
+
+// --- ID Index ---
+// Sorted (id, array index) pairs so lookups in batch jobs are O(log n)
+// instead of a linear scan per record.
+
+struct IdSlot {
+    int id;
+    int index;
+};
+
+int compareIdSlots(const void* a, const void* b) {
+    int idA = ((const struct IdSlot*)a)->id;
+    int idB = ((const struct IdSlot*)b)->id;
+    return (idA > idB) - (idA < idB);
+}
+
+// Returns the array index stored for id, or -1 if not present
+int lookupIdSlot(struct IdSlot* slots, int count, int id) {
+    int low = 0, high = count - 1;
+    while (low <= high) {
+        int mid = low + (high - low) / 2;
+        if (slots[mid].id == id) return slots[mid].index;
+        if (slots[mid].id < id) low = mid + 1;
+        else high = mid - 1;
+    }
+    return -1;
+}
+
 
 // --- File Handling Functions (Operate on AppState) ---
 
-void saveCounters(struct AppState* state) {
-    FILE *fp = fopen(COUNTER_FILE, "wb");
+// Path of a file inside the state's data directory. A path longer than
+// PATH_LEN comes back empty, so opening it fails instead of touching another file.
+void buildDataPath(struct AppState* state, char* fileName, char* out) {
+    if (strcmp(state->dataDir, ".") == 0 || state->dataDir[0] == '\0') {
+        snprintf(out, PATH_LEN, "%s", fileName);
+    } else if (snprintf(out, PATH_LEN, "%s/%s", state->dataDir, fileName) >= PATH_LEN) {
+        printf("Error: Path of '%s' in '%s' is too long.\n", fileName, state->dataDir);
+        out[0] = '\0';
+    }
+}
+
+FILE* openDataFile(struct AppState* state, char* fileName, char* mode) {
+    char path[PATH_LEN];
+    buildDataPath(state, fileName, path);
+    return fopen(path, mode);
+}
+
+// --- Table File I/O ---
+// loadData and saveData move whole files between memory images and disk in one
+// batch: every file of the batch is in flight at once, so a load or save costs
+// about as much as its largest file rather than the sum of all of them.
+// Linux builds submit the batch through io_uring. Elsewhere, or when io_uring
+// is unavailable, each file gets its own worker thread. Images are kept in
+// IO_ALIGN-aligned buffers so the batch can also bypass the page cache
+// (O_DIRECT, see --direct-io).
+
+// One file of a batch and its in-memory image
+struct TableFile {
+    char* name;          // File name inside the data directory
+    unsigned char* data; // IO_ALIGN-aligned image
+    size_t length;       // Bytes of file content
+    size_t capacity;     // Allocated bytes (a multiple of IO_ALIGN)
+    size_t position;     // Read cursor while decoding
+    size_t done;         // Bytes transferred so far
+    int fd;
+    int missing;         // Load: the file does not exist
+    int failed;          // The transfer failed (errno-style code)
+};
+
+struct TableBatch {
+    struct AppState* state;
+    struct TableFile* files;
+    int count;
+    int writing;
+};
+
+void* allocAligned(size_t size) {
+#ifdef _WIN32
+    return _aligned_malloc(size, IO_ALIGN);
+#else
+    void* p = NULL;
+    return posix_memalign(&p, IO_ALIGN, size) == 0 ? p : NULL;
+#endif
+}
+
+void freeAligned(void* p) {
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+size_t roundUpIo(size_t size) {
+    return (size + IO_ALIGN - 1) / IO_ALIGN * IO_ALIGN;
+}
+
+void initTableFile(struct TableFile* f, char* name) {
+    memset(f, 0, sizeof(*f));
+    f->name = name;
+    f->fd = -1;
+}
+
+void freeTableFile(struct TableFile* f) {
+    freeAligned(f->data);
+    f->data = NULL;
+    f->length = f->capacity = 0;
+}
+
+// Make room for at least size bytes. Returns -1 if memory ran out.
+int reserveImage(struct TableFile* f, size_t size) {
+    if (size <= f->capacity) return 0;
+    size_t capacity = roundUpIo(size > f->capacity * 2 ? size : f->capacity * 2);
+    unsigned char* data = allocAligned(capacity);
+    if (data == NULL) return -1;
+    if (f->length > 0) memcpy(data, f->data, f->length);
+    freeAligned(f->data);
+    f->data = data;
+    f->capacity = capacity;
+    return 0;
+}
+
+// fwrite-style append to an image
+size_t writeImage(void* items, size_t size, size_t count, struct TableFile* f) {
+    if (reserveImage(f, f->length + size * count) != 0) {
+        f->failed = 1;
+        return 0;
+    }
+    memcpy(f->data + f->length, items, size * count);
+    f->length += size * count;
+    return count;
+}
+
+// fread-style read from an image: returns the number of whole items read
+size_t readImage(void* items, size_t size, size_t count, struct TableFile* f) {
+    size_t available = (f->length - f->position) / size;
+    if (count > available) count = available;
+    if (count == 0) return 0;
+    memcpy(items, f->data + f->position, size * count);
+    f->position += size * count;
+    return count;
+}
+
+#ifdef _WIN32
+// Worker task: move one whole file with stdio
+void tableFileTask(void* context, int taskIndex, int workerIndex) {
+    struct TableBatch* batch = (struct TableBatch*)context;
+    struct TableFile* f = &batch->files[taskIndex];
+    (void)workerIndex;
+    FILE* fp = openDataFile(batch->state, f->name, batch->writing ? "wb" : "rb");
     if (fp == NULL) {
-        perror("Error opening counter file for writing");
+        if (batch->writing) f->failed = 1;
+        else f->missing = 1;
         return;
     }
-    fwrite(&state->nextPatientId, sizeof(int), 1, fp);
-    fwrite(&state->nextDoctorId, sizeof(int), 1, fp);
-    fwrite(&state->nextAppointmentId, sizeof(int), 1, fp);
-    fwrite(&state->nextBillId, sizeof(int), 1, fp);
-    fclose(fp);
+    if (batch->writing) {
+        if (fwrite(f->data, 1, f->length, fp) != f->length) f->failed = 1;
+    } else {
+        fseek(fp, 0, SEEK_END);
+        long size = ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+        if (size < 0 || reserveImage(f, size > 0 ? size : 1) != 0) {
+            f->failed = 1;
+        } else {
+            f->length = fread(f->data, 1, size, fp);
+        }
+    }
+    if (fclose(fp) != 0) f->failed = 1;
+}
+#else
+// Open every file of the batch and size the read buffers
+void openTableFiles(struct TableBatch* batch) {
+    int direct = (batch->state->ioFlags & IO_DIRECT) != 0;
+    for (int i = 0; i < batch->count; i++) {
+        struct TableFile* f = &batch->files[i];
+        char path[PATH_LEN];
+        int mode = batch->writing ? (O_WRONLY | O_CREAT | O_TRUNC) : O_RDONLY;
+        buildDataPath(batch->state, f->name, path);
+        f->fd = -1;
+#ifdef O_DIRECT
+        if (direct) f->fd = open(path, mode | O_DIRECT, 0644);
+#endif
+        if (f->fd < 0) f->fd = open(path, mode, 0644); // No O_DIRECT on this file system
+        if (f->fd < 0) {
+            if (!batch->writing && errno == ENOENT) f->missing = 1;
+            else f->failed = errno;
+            continue;
+        }
+        if (batch->writing) {
+            // O_DIRECT writes whole blocks; the padding is cut off again afterwards
+            if (reserveImage(f, f->length > 0 ? f->length : 1) != 0) f->failed = ENOMEM;
+            else memset(f->data + f->length, 0, f->capacity - f->length);
+        } else {
+            struct stat st;
+            if (fstat(f->fd, &st) != 0) {
+                f->failed = errno;
+            } else if (reserveImage(f, st.st_size > 0 ? (size_t)st.st_size : 1) != 0) {
+                f->failed = ENOMEM;
+            } else {
+                f->length = st.st_size;
+            }
+        }
+    }
 }
 
-void loadCounters(struct AppState* state) {
-    FILE *fp = fopen(COUNTER_FILE, "rb");
-    if (fp == NULL) {
-        // If file doesn't exist, start IDs from 1 (first run)
-        state->nextPatientId = 1;
-        state->nextDoctorId = 1;
-        state->nextAppointmentId = 1;
-        state->nextBillId = 1;
+// Bytes the next transfer of a file asks for. With O_DIRECT, transfers cover
+// whole blocks: reads stop at end of file, writes send the zero padding too.
+size_t pendingBytes(struct TableBatch* batch, struct TableFile* f) {
+    if (!batch->writing && f->done >= f->length) return 0;
+    size_t total = (batch->state->ioFlags & IO_DIRECT) ? roundUpIo(f->length) : f->length;
+    return total > f->done ? total - f->done : 0;
+}
+
+// Move whatever is left of one file with plain blocking calls
+void finishTableFile(struct TableBatch* batch, struct TableFile* f) {
+    while (f->fd >= 0 && !f->failed) {
+        size_t want = pendingBytes(batch, f);
+        if (want == 0) break;
+        ssize_t n = batch->writing ? pwrite(f->fd, f->data + f->done, want, f->done)
+                                   : pread(f->fd, f->data + f->done, want, f->done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            f->failed = errno;
+        } else if (n == 0) {
+            break; // End of file
+        } else {
+            f->done += n;
+        }
+    }
+}
+
+// Worker task: one file per thread
+void tableFileTask(void* context, int taskIndex, int workerIndex) {
+    struct TableBatch* batch = (struct TableBatch*)context;
+    (void)workerIndex;
+    finishTableFile(batch, &batch->files[taskIndex]);
+}
+
+#ifdef HAVE_IO_URING
+// Minimal io_uring driver (no liburing): one submission of the whole batch,
+// then wait for all completions. Returns -1 if io_uring cannot be used here.
+int runUringBatch(struct TableBatch* batch) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int ringFd = (int)syscall(__NR_io_uring_setup, MAX_TABLE_FILES, &params);
+    if (ringFd < 0) return -1; // ENOSYS, EPERM (disabled), ...
+
+    size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    int singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMap && cqSize > sqSize) sqSize = cqSize;
+    size_t sqeSize = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    unsigned char* sq = mmap(NULL, sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    unsigned char* cq = singleMap ? sq
+        : mmap(NULL, cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+    struct io_uring_sqe* sqes = mmap(NULL, sqeSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    if (sq == MAP_FAILED || cq == MAP_FAILED || sqes == MAP_FAILED) {
+        if (sq != MAP_FAILED) munmap(sq, sqSize);
+        if (!singleMap && cq != MAP_FAILED) munmap(cq, cqSize);
+        if (sqes != MAP_FAILED) munmap(sqes, sqeSize);
+        close(ringFd);
+        return -1;
+    }
+
+    unsigned* sqTail = (unsigned*)(sq + params.sq_off.tail);
+    unsigned sqMask = *(unsigned*)(sq + params.sq_off.ring_mask);
+    unsigned* sqArray = (unsigned*)(sq + params.sq_off.array);
+    unsigned* cqHead = (unsigned*)(cq + params.cq_off.head);
+    unsigned* cqTail = (unsigned*)(cq + params.cq_off.tail);
+    unsigned cqMask = *(unsigned*)(cq + params.cq_off.ring_mask);
+    struct io_uring_cqe* cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    // Queue one read or write per open file
+    unsigned tail = *sqTail;
+    int submitted = 0;
+    for (int i = 0; i < batch->count; i++) {
+        struct TableFile* f = &batch->files[i];
+        size_t want = pendingBytes(batch, f);
+        if (f->fd < 0 || f->failed || want == 0) continue;
+        struct io_uring_sqe* sqe = &sqes[tail & sqMask];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = batch->writing ? IORING_OP_WRITE : IORING_OP_READ;
+        sqe->fd = f->fd;
+        sqe->addr = (unsigned long long)(size_t)(f->data + f->done);
+        sqe->len = (unsigned)want;
+        sqe->off = f->done;
+        sqe->user_data = i;
+        sqArray[tail & sqMask] = tail & sqMask;
+        tail++;
+        submitted++;
+    }
+    __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+
+    // Submit everything and collect completions as they arrive. The kernel
+    // may take fewer entries than offered; the rest are offered again, and
+    // waiting only happens while something is in flight.
+    int completed = 0;
+    int toSubmit = submitted;
+    while (completed < submitted) {
+        int inFlight = submitted - toSubmit - completed;
+        int waitFor = inFlight > 0 ? 1 : 0;
+        int rc = (int)syscall(__NR_io_uring_enter, ringFd, toSubmit, waitFor,
+                              waitFor ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (rc < 0) {
+            if (errno == EINTR) continue;
+            break; // Leave the rest to the blocking path below
+        }
+        if (rc == 0 && inFlight == 0) break; // Nothing accepted, nothing to wait for
+        toSubmit -= rc;
+        unsigned head = *cqHead;
+        while (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe* cqe = &cqes[head & cqMask];
+            struct TableFile* f = &batch->files[cqe->user_data];
+            if (cqe->res >= 0) f->done += cqe->res; // Short transfers are finished below
+            head++;
+            completed++;
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+    }
+
+    munmap(sqes, sqeSize);
+    if (!singleMap) munmap(cq, cqSize);
+    munmap(sq, sqSize);
+    close(ringFd);
+
+    // Short transfers, failed requests (e.g. opcodes an old kernel lacks) and
+    // anything not submitted are completed, or fail for good, synchronously
+    for (int i = 0; i < batch->count; i++) {
+        finishTableFile(batch, &batch->files[i]);
+    }
+    return 0;
+}
+#endif
+#endif
+
+// Read or write every file of a batch at once. Loads set length to the file
+// size (missing files are flagged, not errors). Returns -1 if any file failed.
+int runTableBatch(struct AppState* state, struct TableFile* files, int count, int writing) {
+    struct TableBatch batch;
+    batch.state = state;
+    batch.files = files;
+    batch.count = count;
+    batch.writing = writing;
+    for (int i = 0; i < count; i++) {
+        files[i].done = 0;
+        files[i].position = 0;
+        files[i].failed = 0;
+        files[i].missing = 0;
+        if (!writing) files[i].length = 0;
+    }
+
+#ifdef _WIN32
+    runWorkerPool(tableFileTask, &batch, count, count);
+#else
+    openTableFiles(&batch);
+    int usedRing = -1;
+#ifdef HAVE_IO_URING
+    if (!(state->ioFlags & IO_NO_URING)) usedRing = runUringBatch(&batch);
+#endif
+    if (usedRing != 0) runWorkerPool(tableFileTask, &batch, count, count); // I/O bound: a thread per file
+
+    for (int i = 0; i < count; i++) {
+        struct TableFile* f = &files[i];
+        if (f->fd < 0) continue;
+        if (writing) {
+            if (!f->failed && f->done > f->length && ftruncate(f->fd, f->length) != 0) f->failed = errno;
+        } else if (f->done < f->length) {
+            f->length = f->done; // File shrank while being read
+        }
+        if (close(f->fd) != 0 && !f->failed) f->failed = errno;
+        f->fd = -1;
+    }
+#endif
+
+    int failures = 0;
+    for (int i = 0; i < count; i++) {
+        if (files[i].failed) {
+            printf("Warning: Could not %s '%s'.\n", writing ? "write" : "read", files[i].name);
+            failures++;
+        }
+    }
+    return failures > 0 ? -1 : 0;
+}
+
+void saveCounters(struct AppState* state, struct TableFile* fp) {
+    writeImage(&state->nextPatientId, sizeof(int), 1, fp);
+    writeImage(&state->nextDoctorId, sizeof(int), 1, fp);
+    writeImage(&state->nextAppointmentId, sizeof(int), 1, fp);
+    writeImage(&state->nextBillId, sizeof(int), 1, fp);
+    writeImage(&state->checkpointLsn, sizeof(long long), 1, fp); // Change log position of this save
+    writeImage(&state->archiveNextSegment, sizeof(int), 1, fp);  // Archive segments this save reflects
+}
+
+void loadCounters(struct AppState* state, struct TableFile* fp) {
+    if (fp->missing) {
+        // If file doesn't exist, start IDs from 1 (first run) within the branch's ID range
+        int firstId = state->branchId * BRANCH_ID_STRIDE + 1;
+        state->nextPatientId = firstId;
+        state->nextDoctorId = firstId;
+        state->nextAppointmentId = firstId;
+        state->nextBillId = firstId;
+        state->checkpointLsn = 0;
+        state->archiveCheckpoint = 0;
         //perror("Counter file not found, starting from 1"); // Optional message
         return;
     }
     // Ensure reads are successful before assigning
-    fread(&state->nextPatientId, sizeof(int), 1, fp);
-    fread(&state->nextDoctorId, sizeof(int), 1, fp);
-    fread(&state->nextAppointmentId, sizeof(int), 1, fp);
-    fread(&state->nextBillId, sizeof(int), 1, fp);
-    fclose(fp);
+    readImage(&state->nextPatientId, sizeof(int), 1, fp);
+    readImage(&state->nextDoctorId, sizeof(int), 1, fp);
+    readImage(&state->nextAppointmentId, sizeof(int), 1, fp);
+    readImage(&state->nextBillId, sizeof(int), 1, fp);
+    if (readImage(&state->checkpointLsn, sizeof(long long), 1, fp) != 1) {
+        state->checkpointLsn = 0; // Written before the change log existed
+    }
+    if (readImage(&state->archiveCheckpoint, sizeof(int), 1, fp) != 1) {
+        state->archiveCheckpoint = 0; // Written before the archive existed: check every segment
+    }
 }
 
+// Working hours are stored in doctors[] order; unknown doctors are ignored on load
+void saveDoctorHours(struct AppState* state, struct TableFile* fp) {
+    writeImage(&state->doctorCount, sizeof(int), 1, fp);
+    writeImage(state->doctorHours, sizeof(struct DoctorHours), state->doctorCount, fp);
+}
 
-void saveData(struct AppState* state) {
-    FILE *fp;
+// Slot mask of the working hours: bit s is set if slot s lies fully inside them
+unsigned long long computeHoursMask(struct DoctorHours* hours) {
+    unsigned long long mask = 0;
+    for (int slot = 0; slot < SLOTS_PER_DAY; slot++) {
+        int slotStart = slot * SLOT_MINUTES;
+        if (slotStart >= hours->startMinute && slotStart + SLOT_MINUTES <= hours->endMinute) {
+            mask |= 1ULL << slot;
+        }
+    }
+    return mask;
+}
 
-    // Save Patients
-    fp = fopen(PATIENT_FILE, "wb");
-    if (fp == NULL) { perror("Error opening patient file for writing"); return; }
-    fwrite(&state->patientCount, sizeof(int), 1, fp);
-    fwrite(state->patients, sizeof(struct Patient), state->patientCount, fp);
-    fclose(fp);
+void setDoctorHours(struct AppState* state, int doctorIndex, struct DoctorHours* hours) {
+    state->doctorHours[doctorIndex] = *hours;
+    state->doctorHours[doctorIndex].doctorId = state->doctors[doctorIndex].id;
+    state->hoursMask[doctorIndex] = computeHoursMask(hours);
+}
 
-    // Save Doctors
-    fp = fopen(DOCTOR_FILE, "wb");
-    if (fp == NULL) { perror("Error opening doctor file for writing"); return; }
-    fwrite(&state->doctorCount, sizeof(int), 1, fp);
-    fwrite(state->doctors, sizeof(struct Doctor), state->doctorCount, fp);
-    fclose(fp);
+void loadDoctorHours(struct AppState* state, struct TableFile* fp) {
+    struct DoctorHours none = {0, 0, 0, 0}; // No structured hours: nothing bookable
+    for (int i = 0; i < state->doctorCount; i++) {
+        setDoctorHours(state, i, &none);
+    }
 
-    // Save Appointments
-    fp = fopen(APPOINTMENT_FILE, "wb");
-    if (fp == NULL) { perror("Error opening appointment file for writing"); return; }
-    fwrite(&state->appointmentCount, sizeof(int), 1, fp);
-    fwrite(state->appointments, sizeof(struct Appointment), state->appointmentCount, fp);
-    fclose(fp);
+    if (fp->missing) return; // File not found is okay (no hours set yet)
 
-    // Save Bills
-    fp = fopen(BILL_FILE, "wb");
-    if (fp == NULL) { perror("Error opening bill file for writing"); return; }
-    fwrite(&state->billCount, sizeof(int), 1, fp);
-    fwrite(state->bills, sizeof(struct Bill), state->billCount, fp);
-    fclose(fp);
+    int readCount;
+    struct DoctorHours hours;
+    if (readImage(&readCount, sizeof(int), 1, fp) == 1) {
+        for (int r = 0; r < readCount && readImage(&hours, sizeof(struct DoctorHours), 1, fp) == 1; r++) {
+            for (int i = 0; i < state->doctorCount; i++) {
+                if (state->doctors[i].id == hours.doctorId) {
+                    setDoctorHours(state, i, &hours);
+                    break;
+                }
+            }
+        }
+    } else {
+        printf("Warning: Could not read count from hours file.\n");
+    }
+}
+
+void savePatientHistory(struct AppState* state, struct TableFile* fp) {
+    struct PatientHistory* history = &state->history;
+    writeImage(&history->versionCount, sizeof(int), 1, fp);
+    writeImage(&history->dataUsed, sizeof(int), 1, fp);
+    writeImage(history->versions, sizeof(struct PatientVersion), history->versionCount, fp);
+    writeImage(history->data, 1, history->dataUsed, fp);
+}
+
+void loadPatientHistory(struct AppState* state, struct TableFile* fp) {
+    struct PatientHistory* history = &state->history;
+    history->versionCount = 0;
+    history->dataUsed = 0;
+
+    if (!fp->missing) {
+        int versionCount, dataUsed;
+        if (readImage(&versionCount, sizeof(int), 1, fp) == 1 && readImage(&dataUsed, sizeof(int), 1, fp) == 1
+            && versionCount >= 0 && versionCount <= MAX_HISTORY_VERSIONS
+            && dataUsed >= 0 && dataUsed <= HISTORY_DATA_SIZE
+            && readImage(history->versions, sizeof(struct PatientVersion), versionCount, fp) == (size_t)versionCount
+            && readImage(history->data, 1, dataUsed, fp) == (size_t)dataUsed) {
+            history->versionCount = versionCount;
+            history->dataUsed = dataUsed;
+        } else {
+            printf("Warning: History file is damaged; patient history starts empty.\n");
+        }
+    }
+    rebuildHistoryHeads(history);
+}
+
+// Files of one load/save batch. The counters come last: they are written
+// separately, after the tables they describe.
+#define FILE_PATIENTS 0
+#define FILE_DOCTORS 1
+#define FILE_APPOINTMENTS 2
+#define FILE_BILLS 3
+#define FILE_HOURS 4
+#define FILE_HISTORY 5
+#define FILE_COUNTERS 6
+#define TABLE_FILE_COUNT 7
+
+void initDataFiles(struct TableFile* files) {
+    initTableFile(&files[FILE_PATIENTS], PATIENT_FILE);
+    initTableFile(&files[FILE_DOCTORS], DOCTOR_FILE);
+    initTableFile(&files[FILE_APPOINTMENTS], APPOINTMENT_FILE);
+    initTableFile(&files[FILE_BILLS], BILL_FILE);
+    initTableFile(&files[FILE_HOURS], HOURS_FILE);
+    initTableFile(&files[FILE_HISTORY], HISTORY_FILE);
+    initTableFile(&files[FILE_COUNTERS], COUNTER_FILE);
+}
+
+void freeDataFiles(struct TableFile* files) {
+    for (int i = 0; i < TABLE_FILE_COUNT; i++) {
+        freeTableFile(&files[i]);
+    }
+}
+
+// Returns 0 on success, -1 if a table could not be written
+int saveData(struct AppState* state) {
+    struct TableFile files[TABLE_FILE_COUNT];
+    struct TableFile* fp;
+    int rc = 0;
+    initDataFiles(files);
+
+    // Build every file image in memory first
+    fp = &files[FILE_PATIENTS];
+    writeImage(&state->patientCount, sizeof(int), 1, fp);
+    writeImage(state->patients, sizeof(struct Patient), state->patientCount, fp);
+
+    fp = &files[FILE_DOCTORS];
+    writeImage(&state->doctorCount, sizeof(int), 1, fp);
+    writeImage(state->doctors, sizeof(struct Doctor), state->doctorCount, fp);
+
+    fp = &files[FILE_APPOINTMENTS];
+    writeImage(&state->appointmentCount, sizeof(int), 1, fp);
+    writeImage(state->appointments, sizeof(struct Appointment), state->appointmentCount, fp);
+
+    fp = &files[FILE_BILLS];
+    writeImage(&state->billCount, sizeof(int), 1, fp);
+    writeImage(state->bills, sizeof(struct Bill), state->billCount, fp);
+
+    saveDoctorHours(state, &files[FILE_HOURS]);
+    savePatientHistory(state, &files[FILE_HISTORY]);
+
+    for (int i = 0; i < FILE_COUNTERS; i++) {
+        if (files[i].failed) {
+            printf("Error: Not enough memory to save '%s'.\n", files[i].name);
+            freeDataFiles(files);
+            return -1;
+        }
+    }
 
-    // Save Counters
-    saveCounters(state);
+    // Write all tables at once
+    if (runTableBatch(state, files, FILE_COUNTERS, 1) != 0) {
+        freeDataFiles(files);
+        return -1;
+    }
+
+    // Start a fresh change log once it gets long, then record what this save covers.
+    // The counters go last so they never claim tables that were not written.
+    if (state->changeLog != NULL && state->logRecords > LOG_COMPACT_RECORDS) {
+        resetChangeLog(state);
+    }
+    state->checkpointLsn = state->lastLsn;
+    saveCounters(state, &files[FILE_COUNTERS]);
+    if (state->triageLog != NULL) compactTriageLog(state);
+    if (files[FILE_COUNTERS].failed || runTableBatch(state, &files[FILE_COUNTERS], 1, 1) != 0) rc = -1;
 
-    printf("Data saved successfully.\n");
+    freeDataFiles(files);
+    return rc;
 }
 
 void loadData(struct AppState* state) {
-    FILE *fp;
+    struct TableFile files[TABLE_FILE_COUNT];
+    struct TableFile* fp;
     int readCount;
 
     // Initialize counts to 0 before loading
@@ -239,105 +1466,128 @@ void loadData(struct AppState* state) {
     state->appointmentCount = 0;
     state->billCount = 0;
 
+    // Read every file at once, then decode the images
+    initDataFiles(files);
+    runTableBatch(state, files, TABLE_FILE_COUNT, 0);
+
     // Load Counters first
-    loadCounters(state);
+    loadCounters(state, &files[FILE_COUNTERS]);
 
     // Load Patients
-    fp = fopen(PATIENT_FILE, "rb");
-    if (fp != NULL) {
-        if (fread(&readCount, sizeof(int), 1, fp) == 1) { // Check if read was successful
+    fp = &files[FILE_PATIENTS];
+    if (!fp->missing) {
+        if (readImage(&readCount, sizeof(int), 1, fp) == 1) { // Check if read was successful
             if (readCount >= 0 && readCount <= MAX_PATIENTS) {
-                int actualRead = fread(state->patients, sizeof(struct Patient), readCount, fp);
+                int actualRead = readImage(state->patients, sizeof(struct Patient), readCount, fp);
                 state->patientCount = actualRead;
                 if (actualRead != readCount) {
                     printf("Warning: Mismatch in expected (%d) and read (%d) patient records.\n", readCount, actualRead);
                 }
             } else if (readCount > MAX_PATIENTS) {
                 printf("Warning: Patient file contains more records (%d) than MAX_PATIENTS (%d). Loading truncated list.\n", readCount, MAX_PATIENTS);
-                state->patientCount = fread(state->patients, sizeof(struct Patient), MAX_PATIENTS, fp);
+                state->patientCount = readImage(state->patients, sizeof(struct Patient), MAX_PATIENTS, fp);
             } else {
                  printf("Warning: Invalid count (%d) in patient file.\n", readCount);
             }
         } else {
             printf("Warning: Could not read count from patient file.\n");
         }
-        fclose(fp);
     } // else: File not found is okay, count remains 0
 
 
     // Load Doctors (similar logic)
-    fp = fopen(DOCTOR_FILE, "rb");
-    if (fp != NULL) {
-        if (fread(&readCount, sizeof(int), 1, fp) == 1) {
+    fp = &files[FILE_DOCTORS];
+    if (!fp->missing) {
+        if (readImage(&readCount, sizeof(int), 1, fp) == 1) {
             if (readCount >= 0 && readCount <= MAX_DOCTORS) {
-                int actualRead = fread(state->doctors, sizeof(struct Doctor), readCount, fp);
+                int actualRead = readImage(state->doctors, sizeof(struct Doctor), readCount, fp);
                 state->doctorCount = actualRead;
                  if (actualRead != readCount) {
                      printf("Warning: Mismatch in expected (%d) and read (%d) doctor records.\n", readCount, actualRead);
                  }
             } else if (readCount > MAX_DOCTORS) {
                 printf("Warning: Doctor file contains more records (%d) than MAX_DOCTORS (%d). Loading truncated list.\n", readCount, MAX_DOCTORS);
-                state->doctorCount = fread(state->doctors, sizeof(struct Doctor), MAX_DOCTORS, fp);
+                state->doctorCount = readImage(state->doctors, sizeof(struct Doctor), MAX_DOCTORS, fp);
             } else {
                 printf("Warning: Invalid count (%d) in doctor file.\n", readCount);
             }
         } else {
             printf("Warning: Could not read count from doctor file.\n");
         }
-        fclose(fp);
     }
 
     // Load Appointments (similar logic)
-    fp = fopen(APPOINTMENT_FILE, "rb");
-    if (fp != NULL) {
-        if(fread(&readCount, sizeof(int), 1, fp) == 1) {
+    fp = &files[FILE_APPOINTMENTS];
+    if (!fp->missing) {
+        if(readImage(&readCount, sizeof(int), 1, fp) == 1) {
             if (readCount >= 0 && readCount <= MAX_APPOINTMENTS) {
-                int actualRead = fread(state->appointments, sizeof(struct Appointment), readCount, fp);
+                int actualRead = readImage(state->appointments, sizeof(struct Appointment), readCount, fp);
                 state->appointmentCount = actualRead;
                 if (actualRead != readCount) {
                      printf("Warning: Mismatch in expected (%d) and read (%d) appointment records.\n", readCount, actualRead);
                 }
             } else if (readCount > MAX_APPOINTMENTS){
                 printf("Warning: Appointment file contains more records (%d) than MAX_APPOINTMENTS (%d). Loading truncated list.\n", readCount, MAX_APPOINTMENTS);
-                state->appointmentCount = fread(state->appointments, sizeof(struct Appointment), MAX_APPOINTMENTS, fp);
+                state->appointmentCount = readImage(state->appointments, sizeof(struct Appointment), MAX_APPOINTMENTS, fp);
             } else {
                  printf("Warning: Invalid count (%d) in appointment file.\n", readCount);
             }
         } else {
              printf("Warning: Could not read count from appointment file.\n");
         }
-        fclose(fp);
     }
 
 
      // Load Bills (similar logic)
-    fp = fopen(BILL_FILE, "rb");
-    if (fp != NULL) {
-         if (fread(&readCount, sizeof(int), 1, fp) == 1) {
+    fp = &files[FILE_BILLS];
+    if (!fp->missing) {
+         if (readImage(&readCount, sizeof(int), 1, fp) == 1) {
             if (readCount >= 0 && readCount <= MAX_BILLS) {
-                int actualRead = fread(state->bills, sizeof(struct Bill), readCount, fp);
+                int actualRead = readImage(state->bills, sizeof(struct Bill), readCount, fp);
                 state->billCount = actualRead;
                 if (actualRead != readCount) {
                      printf("Warning: Mismatch in expected (%d) and read (%d) bill records.\n", readCount, actualRead);
                 }
             } else if (readCount > MAX_BILLS) {
                 printf("Warning: Bill file contains more records (%d) than MAX_BILLS (%d). Loading truncated list.\n", readCount, MAX_BILLS);
-                state->billCount = fread(state->bills, sizeof(struct Bill), MAX_BILLS, fp);
+                state->billCount = readImage(state->bills, sizeof(struct Bill), MAX_BILLS, fp);
             } else {
                  printf("Warning: Invalid count (%d) in bill file.\n", readCount);
             }
          } else {
              printf("Warning: Could not read count from bill file.\n");
          }
-        fclose(fp);
     }
 
+    // Archived records are dropped before anything is built from the tables
+    loadArchiveCatalog(state);
+    dropArchivedHotRecords(state);
+
+    // Working hours and the slot calendar depend on the loaded doctors and appointments
+    loadDoctorHours(state, &files[FILE_HOURS]);
+    rebuildSlotCalendar(state, todayDayNumber(NULL));
+    loadPatientHistory(state, &files[FILE_HISTORY]);
+    freeDataFiles(files);
+    rebuildNameIndex(state);
+    rebuildDashboard(state);
+    rebuildDateIndex(state);
+    resetVersionStores(state);
+    loadTriageLog(state); // Walk-in queues refer to the loaded patients and doctors
+
     // Optional: Add a message indicating data loading attempt
     // printf("Data loaded from files (if they existed).\n");
 }
 
 // --- Patient Management Functions (Operate on AppState) ---
 
+// IDs of branch b must stay below (b + 1) * BRANCH_ID_STRIDE, where the next
+// branch's IDs begin. Prints a message and returns 1 once nextId has reached it.
+int branchIdsUsedUp(struct AppState* state, int nextId, char* what) {
+    if ((long long)nextId < (long long)(state->branchId + 1) * BRANCH_ID_STRIDE) return 0;
+    printf("Branch %d has used up its %s IDs; no more can be added.\n", state->branchId, what);
+    return 1;
+}
+
 int findPatientById(struct AppState* state, int id) {
     for (int i = 0; i < state->patientCount; i++) {
         if (state->patients[i].id == id) {
@@ -365,6 +1615,7 @@ void addPatient(struct AppState* state) {
         printf("Maximum patient limit reached.\n");
         return;
     }
+    if (branchIdsUsedUp(state, state->nextPatientId, "patient")) return;
 
     struct Patient p; // Use 'struct Patient'
     p.id = state->nextPatientId++;
@@ -376,7 +1627,7 @@ void addPatient(struct AppState* state) {
     getStringInput("Enter Disease/Condition: ", p.disease, DISEASE_LEN);
     getStringInput("Enter Contact Number: ", p.contact, CONTACT_LEN);
 
-    state->patients[state->patientCount++] = p;
+    insertPatientRecord(state, &p);
     printf("Patient added successfully with ID: %d\n", p.id);
 }
 
@@ -406,7 +1657,8 @@ void editPatient(struct AppState* state) {
         return;
     }
 
-    struct Patient* p = &state->patients[index]; // Pointer for easier access
+    struct Patient edited = state->patients[index];
+    struct Patient* p = &edited; // Pointer for easier access
 
     printf("--- Editing Patient ID: %d ---\n", id);
 
@@ -444,6 +1696,7 @@ void editPatient(struct AppState* state) {
         strcpy(p->contact, tempBuffer);
     }
 
+    updatePatientRecord(state, index, &edited);
     printf("Patient information updated successfully.\n");
 }
 
@@ -466,11 +1719,7 @@ void deletePatient(struct AppState* state) {
         return;
     }
 
-    // Shift elements to fill the gap
-    for (int i = index; i < state->patientCount - 1; i++) {
-        state->patients[i] = state->patients[i + 1];
-    }
-    state->patientCount--;
+    removePatientAt(state, index);
 
     printf("Patient with ID %d deleted successfully.\n", id);
 }
@@ -496,11 +1745,32 @@ char* getDoctorNameById(struct AppState* state, int id) {
 }
 
 
+// Prompt for working days and hours; re-asks until the input parses
+void readWorkingHours(struct DoctorHours* hours) {
+    char buffer[AVAILABILITY_LEN];
+    while (1) {
+        getStringInput("Enter Working Days (e.g., Mon-Fri or Mon,Wed,Fri): ", buffer, AVAILABILITY_LEN);
+        hours->workDays = parseWorkDays(buffer);
+        if (hours->workDays > 0) break;
+        printf("Invalid days. Use three-letter names like Mon, Tue, Wed.\n");
+    }
+    while (1) {
+        getStringInput("Enter Start Time (HH:MM): ", buffer, AVAILABILITY_LEN);
+        hours->startMinute = parseTime(buffer);
+        getStringInput("Enter End Time (HH:MM): ", buffer, AVAILABILITY_LEN);
+        hours->endMinute = parseTime(buffer);
+        if (strcmp(buffer, "24:00") == 0) hours->endMinute = 24 * 60;
+        if (hours->startMinute >= 0 && hours->endMinute > hours->startMinute) break;
+        printf("Invalid hours. End time must be after start time.\n");
+    }
+}
+
 void addDoctor(struct AppState* state) {
     if (state->doctorCount >= MAX_DOCTORS) {
         printf("Maximum doctor limit reached.\n");
         return;
     }
+    if (branchIdsUsedUp(state, state->nextDoctorId, "doctor")) return;
 
     struct Doctor d; // Use 'struct Doctor'
     d.id = state->nextDoctorId++;
@@ -510,10 +1780,28 @@ void addDoctor(struct AppState* state) {
     getStringInput("Enter Specialization: ", d.specialization, SPECIALIZATION_LEN);
     getStringInput("Enter Availability (e.g., Mon-Fri 9am-5pm): ", d.availability, AVAILABILITY_LEN);
 
-    state->doctors[state->doctorCount++] = d;
+    struct DoctorHours hours;
+    readWorkingHours(&hours);
+
+    insertDoctorRecord(state, &d, &hours);
     printf("Doctor added successfully with ID: %d\n", d.id);
 }
 
+// Update the structured working hours of an existing doctor
+void editDoctorHours(struct AppState* state) {
+    int id = getIntInput("Enter Doctor ID: ");
+    int index = findDoctorById(state, id);
+    if (index == -1) {
+        printf("Doctor with ID %d not found.\n", id);
+        return;
+    }
+    printf("Current Availability: %s\n", state->doctors[index].availability);
+    struct DoctorHours hours;
+    readWorkingHours(&hours);
+    updateDoctorHours(state, index, &hours);
+    printf("Working hours updated for Dr. %s.\n", state->doctors[index].name);
+}
+
 void viewDoctors(struct AppState* state) {
     printf("\n--- Doctor List (%d) ---\n", state->doctorCount);
     if (state->doctorCount == 0) {
@@ -558,270 +1846,4752 @@ void searchDoctor(struct AppState* state) {
     }
 }
 
-// --- Appointment Management Functions (Operate on AppState) ---
+// --- Slot Calendar ---
+// bookedSlots[doctor][day] has bit s set when the doctor has an appointment in
+// slot s of that day. Free slots are hoursMask & ~bookedSlots, so a whole day
+// for one doctor is checked with a couple of word operations.
+
+// Slot bit of an appointment, or -1 if its date/time is unparsable or off-calendar.
+// *doctorIndex and *dayOffset are set when the slot is valid.
+int appointmentSlot(struct AppState* state, struct Appointment* appt, int* doctorIndex, int* dayOffset) {
+    int day = parseDate(appt->date);
+    int minute = parseTime(appt->time);
+    if (day == -1 || minute == -1) return -1;
+    *dayOffset = day - state->calendarStartDay;
+    if (*dayOffset < 0 || *dayOffset >= CALENDAR_DAYS) return -1;
+    *doctorIndex = findDoctorById(state, appt->doctorId);
+    if (*doctorIndex == -1) return -1;
+    return minute / SLOT_MINUTES;
+}
 
-int findAppointmentById(struct AppState* state, int id) {
+void markAppointmentSlot(struct AppState* state, struct Appointment* appt) {
+    int doctorIndex, dayOffset;
+    int slot = appointmentSlot(state, appt, &doctorIndex, &dayOffset);
+    if (slot != -1) {
+        state->bookedSlots[doctorIndex][dayOffset] |= 1ULL << slot;
+    }
+}
+
+// Clear the slot of a removed appointment unless another appointment still uses it
+void unmarkAppointmentSlot(struct AppState* state, struct Appointment* appt) {
+    int doctorIndex, dayOffset;
+    int slot = appointmentSlot(state, appt, &doctorIndex, &dayOffset);
+    if (slot == -1) return;
     for (int i = 0; i < state->appointmentCount; i++) {
-        if (state->appointments[i].id == id) {
-            return i; // Return index
+        struct Appointment* other = &state->appointments[i];
+        if (other->doctorId == appt->doctorId && strcmp(other->date, appt->date) == 0) {
+            int otherMinute = parseTime(other->time);
+            if (otherMinute != -1 && otherMinute / SLOT_MINUTES == slot) return; // Still booked
         }
     }
-    return -1; // Not found
+    state->bookedSlots[doctorIndex][dayOffset] &= ~(1ULL << slot);
 }
 
-void scheduleAppointment(struct AppState* state) {
-    if (state->appointmentCount >= MAX_APPOINTMENTS) {
-        printf("Maximum appointment limit reached.\n");
-        return;
+// Re-anchor the calendar at startDay and mark every appointment in range
+void rebuildSlotCalendar(struct AppState* state, int startDay) {
+    state->calendarStartDay = startDay;
+    memset(state->bookedSlots, 0, sizeof(state->bookedSlots));
+    for (int i = 0; i < state->appointmentCount; i++) {
+        markAppointmentSlot(state, &state->appointments[i]);
     }
-    if (state->patientCount == 0) {
-        printf("No patients in the system. Please add a patient first.\n");
-        return;
+}
+
+struct FreeSlot {
+    int doctorIndex;
+    int day;
+    int slot;
+};
+
+// Earliest free slots among doctors whose specialization contains the given text,
+// ordered by day, time, then doctor. Days before today and past slots of today are
+// skipped. Returns the number of slots stored in out (at most limit).
+int findFreeSlots(struct AppState* state, char* specialization, int firstDay, int dayCount,
+                  int limit, struct FreeSlot* out) {
+    int matching[MAX_DOCTORS];
+    int matchCount = 0;
+    int nowMinute;
+    int today = todayDayNumber(&nowMinute);
+
+    for (int i = 0; i < state->doctorCount; i++) {
+        if (state->hoursMask[i] != 0 && strstr(state->doctors[i].specialization, specialization) != NULL) {
+            matching[matchCount++] = i;
+        }
     }
-     if (state->doctorCount == 0) {
-        printf("No doctors in the system. Please add a doctor first.\n");
-        return;
+    if (matchCount == 0 || limit <= 0) return 0;
+
+    if (firstDay < today) {
+        dayCount -= today - firstDay;
+        firstDay = today;
+    }
+    if (dayCount > CALENDAR_DAYS) dayCount = CALENDAR_DAYS;
+    // Move the calendar if the window is not inside it
+    if (firstDay < state->calendarStartDay || firstDay + dayCount > state->calendarStartDay + CALENDAR_DAYS) {
+        rebuildSlotCalendar(state, firstDay);
     }
 
-    struct Appointment appt; // Use 'struct Appointment'
-    appt.id = state->nextAppointmentId++;
-    int patientId, doctorId;
-    int patientIndex, doctorIndex;
+    int found = 0;
+    unsigned long long freeMask[MAX_DOCTORS];
+    for (int day = firstDay; day < firstDay + dayCount && found < limit; day++) {
+        int offset = day - state->calendarStartDay;
+        int weekdayBit = 1 << weekdayOf(day);
+        unsigned long long anyFree = 0;
+
+        // Slots that have already started today cannot be booked
+        unsigned long long notPast = ~0ULL;
+        if (day == today) {
+            int firstSlot = (nowMinute + SLOT_MINUTES - 1) / SLOT_MINUTES;
+            notPast = firstSlot >= 64 ? 0 : ~0ULL << firstSlot;
+        }
 
-    printf("--- Schedule New Appointment ---\n");
+        for (int m = 0; m < matchCount; m++) {
+            int d = matching[m];
+            freeMask[m] = 0;
+            if (state->doctorHours[d].workDays & weekdayBit) {
+                freeMask[m] = state->hoursMask[d] & ~state->bookedSlots[d][offset] & notPast;
+                anyFree |= freeMask[m];
+            }
+        }
 
-    // Get and validate Patient ID
-    viewPatients(state); // Show available patients
-    while (1) {
-        patientId = getIntInput("Enter Patient ID: ");
-        patientIndex = findPatientById(state, patientId);
-        if (patientIndex != -1) {
-            appt.patientId = patientId;
-            break;
-        } else {
-            printf("Invalid Patient ID. Please try again.\n");
+        // Walk the slots that are free for at least one doctor, earliest first
+        while (anyFree != 0 && found < limit) {
+            int slot = lowestSetBit(anyFree);
+            unsigned long long bit = 1ULL << slot;
+            for (int m = 0; m < matchCount && found < limit; m++) {
+                if (freeMask[m] & bit) {
+                    out[found].doctorIndex = matching[m];
+                    out[found].day = day;
+                    out[found].slot = slot;
+                    found++;
+                }
+            }
+            anyFree &= anyFree - 1;
         }
     }
+    return found;
+}
 
-    // Get and validate Doctor ID
-    viewDoctors(state); // Show available doctors
-     while (1) {
-        doctorId = getIntInput("Enter Doctor ID: ");
-        doctorIndex = findDoctorById(state, doctorId);
-        if (doctorIndex != -1) {
-            appt.doctorId = doctorId;
-            break;
-        } else {
-            printf("Invalid Doctor ID. Please try again.\n");
+void findAvailableSlots(struct AppState* state) {
+    char specialization[SPECIALIZATION_LEN];
+    char dateText[DATE_LEN + 2];
+    struct FreeSlot slots[MAX_FREE_SLOTS];
+
+    printf("--- Find Next Available Slots ---\n");
+    getStringInput("Enter Specialization: ", specialization, SPECIALIZATION_LEN);
+    getStringInput("Enter Start Date (YYYY-MM-DD, blank for today): ", dateText, sizeof(dateText));
+    int firstDay = todayDayNumber(NULL);
+    if (dateText[0] != '\0') {
+        firstDay = parseDate(dateText);
+        if (firstDay == -1) {
+            printf("Invalid date.\n");
+            return;
         }
     }
+    int dayCount = getIntInput("Search how many days? ");
+    if (dayCount < 1 || dayCount > CALENDAR_DAYS) {
+        printf("Please enter between 1 and %d days.\n", CALENDAR_DAYS);
+        return;
+    }
+    int limit = getIntInput("How many slots to show? ");
+    if (limit < 1) return;
+    if (limit > MAX_FREE_SLOTS) limit = MAX_FREE_SLOTS;
 
-    // Get Date and Time
-    getStringInput("Enter Appointment Date (YYYY-MM-DD): ", appt.date, DATE_LEN);
-    getStringInput("Enter Appointment Time (HH:MM): ", appt.time, TIME_LEN);
+    int found = findFreeSlots(state, specialization, firstDay, dayCount, limit, slots);
+    if (found == 0) {
+        printf("No free slots found for '%s' in that window.\n", specialization);
+        return;
+    }
+    printf("-------------------------------------------------------------------\n");
+    printf("Date       | Time  | Doctor ID | Doctor Name        | Specialization\n");
+    printf("-------------------------------------------------------------------\n");
+    for (int i = 0; i < found; i++) {
+        char date[DATE_LEN];
+        struct Doctor* d = &state->doctors[slots[i].doctorIndex];
+        int minute = slots[i].slot * SLOT_MINUTES;
+        formatDate(slots[i].day, date);
+        printf("%-10s | %02d:%02d | %-9d | %-18s | %s\n",
+               date, minute / 60, minute % 60, d->id, d->name, d->specialization);
+    }
+    printf("-------------------------------------------------------------------\n");
+}
 
-    state->appointments[state->appointmentCount++] = appt;
-    printf("Appointment scheduled successfully for Patient %s with Dr. %s on %s at %s (Appt ID: %d)\n",
-           state->patients[patientIndex].name, state->doctors[doctorIndex].name, appt.date, appt.time, appt.id);
+// --- Change Log (Replication) ---
+// The primary appends one fixed-size record per change to changes.log in the
+// branch's data directory and flushes it. A replica process (--replica) tails
+// the file and applies the same changes to its own AppState.
+//
+// Each log generation starts with a header record followed by a full image of
+// the tables, so a replica can always rebuild from the log alone. A new
+// generation is started when the log grows past LOG_COMPACT_RECORDS at save
+// time, or when the primary starts from .dat files that do not match the log
+// (changes made after the last save were discarded). Replicas notice the new
+// header and rebuild.
+
+#define CHANGE_MAGIC 0x48434C47 // "HCLG"
+
+#define TABLE_LOG_HEADER 0
+#define TABLE_PATIENT 1
+#define TABLE_DOCTOR 2
+#define TABLE_HOURS 3
+#define TABLE_APPOINTMENT 4
+#define TABLE_BILL 5
+
+#define OP_UPSERT 1 // Insert, or replace the record with the same ID
+#define OP_DELETE 2
+
+struct ChangeRecord {
+    int magic;
+    int table;
+    int op;
+    int recordId;
+    long long lsn;        // Log sequence number, increasing by one per record
+    long long timestamp;  // Wall-clock time the change was made
+    long long generation; // Header record: identifies this log generation
+    int nextIds[4];       // ID counters after the change
+    union {
+        struct Patient patient;
+        struct Doctor doctor;
+        struct DoctorHours hours;
+        struct Appointment appointment;
+        struct Bill bill;
+    } data;
+    unsigned int checksum;
+};
+
+// FNV-1a over everything before the checksum field
+unsigned int changeChecksum(struct ChangeRecord* record) {
+    unsigned char* bytes = (unsigned char*)record;
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < offsetof(struct ChangeRecord, checksum); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
 }
 
-void viewAppointments(struct AppState* state) {
-    printf("\n--- Scheduled Appointments (%d) ---\n", state->appointmentCount);
-    if (state->appointmentCount == 0) {
-        printf("No appointments scheduled.\n");
+int isValidChangeRecord(struct ChangeRecord* record) {
+    return record->magic == CHANGE_MAGIC && record->checksum == changeChecksum(record);
+}
+
+void writeChangeRecord(struct AppState* state, FILE* fp, int table, int op, int recordId,
+                       void* data, size_t dataSize) {
+    struct ChangeRecord record;
+    memset(&record, 0, sizeof(record)); // Deterministic padding for the checksum
+    record.magic = CHANGE_MAGIC;
+    record.table = table;
+    record.op = op;
+    record.recordId = recordId;
+    record.lsn = ++state->lastLsn;
+    record.timestamp = (long long)time(NULL);
+    record.generation = state->logGeneration;
+    record.nextIds[0] = state->nextPatientId;
+    record.nextIds[1] = state->nextDoctorId;
+    record.nextIds[2] = state->nextAppointmentId;
+    record.nextIds[3] = state->nextBillId;
+    if (data != NULL) memcpy(&record.data, data, dataSize);
+    record.checksum = changeChecksum(&record);
+    fwrite(&record, sizeof(record), 1, fp);
+    state->logRecords++;
+}
+
+// Log one change (no-op when this process keeps no change log, e.g. replicas)
+void logChange(struct AppState* state, int table, int op, int recordId, void* data, size_t dataSize) {
+    if (state->changeLog == NULL) return;
+    writeChangeRecord(state, state->changeLog, table, op, recordId, data, dataSize);
+    fflush(state->changeLog); // Make it visible to replicas right away
+}
+
+// Write a new log generation: header plus a full image of the current tables.
+// The new file is written aside and renamed over the old one.
+void resetChangeLog(struct AppState* state) {
+    char path[PATH_LEN], tempPath[PATH_LEN + 8];
+    buildDataPath(state, CHANGE_LOG_FILE, path);
+    snprintf(tempPath, sizeof(tempPath), "%s.tmp", path);
+
+    if (state->changeLog != NULL) {
+        fclose(state->changeLog);
+        state->changeLog = NULL;
+    }
+    FILE* fp = fopen(tempPath, "wb");
+    if (fp == NULL) {
+        perror("Error opening change log for writing");
         return;
     }
-    printf("-------------------------------------------------------------------------------------------\n");
-    printf("Appt ID | Patient ID | Patient Name       | Doctor ID | Doctor Name        | Date       | Time  \n");
-    printf("-------------------------------------------------------------------------------------------\n");
-
+    state->logRecords = 0;
+    state->logGeneration = (long long)time(NULL) * 1000000 + (state->lastLsn + 1) % 1000000;
+    writeChangeRecord(state, fp, TABLE_LOG_HEADER, OP_UPSERT, 0, NULL, 0);
+    for (int i = 0; i < state->patientCount; i++) {
+        writeChangeRecord(state, fp, TABLE_PATIENT, OP_UPSERT, state->patients[i].id, &state->patients[i], sizeof(struct Patient));
+    }
+    for (int i = 0; i < state->doctorCount; i++) {
+        writeChangeRecord(state, fp, TABLE_DOCTOR, OP_UPSERT, state->doctors[i].id, &state->doctors[i], sizeof(struct Doctor));
+        writeChangeRecord(state, fp, TABLE_HOURS, OP_UPSERT, state->doctors[i].id, &state->doctorHours[i], sizeof(struct DoctorHours));
+    }
     for (int i = 0; i < state->appointmentCount; i++) {
-        char* patientName = getPatientNameById(state, state->appointments[i].patientId);
-        char* doctorName = getDoctorNameById(state, state->appointments[i].doctorId);
-
-        printf("%-7d | %-10d | %-18s | %-9d | %-18s | %-10s | %-5s\n",
-               state->appointments[i].id,
-               state->appointments[i].patientId, patientName,
-               state->appointments[i].doctorId, doctorName,
-               state->appointments[i].date, state->appointments[i].time);
+        writeChangeRecord(state, fp, TABLE_APPOINTMENT, OP_UPSERT, state->appointments[i].id, &state->appointments[i], sizeof(struct Appointment));
+    }
+    for (int i = 0; i < state->billCount; i++) {
+        writeChangeRecord(state, fp, TABLE_BILL, OP_UPSERT, state->bills[i].id, &state->bills[i], sizeof(struct Bill));
+    }
+    if (fclose(fp) != 0) {
+        perror("Error writing change log");
+        return;
+    }
+    if (replaceFile(tempPath, path) != 0) {
+        perror("Error replacing change log");
+        return;
+    }
+    state->changeLog = fopen(path, "ab");
+    if (state->changeLog == NULL) {
+        perror("Error opening change log for appending");
     }
-    printf("-------------------------------------------------------------------------------------------\n");
 }
 
-void cancelAppointment(struct AppState* state) {
-    int id = getIntInput("Enter Appointment ID to cancel: ");
-    int index = findAppointmentById(state, id);
+// Open the change log for appending after loadData. An existing log is only
+// continued if it ends exactly at the saved checkpoint; otherwise it is replaced.
+void openChangeLog(struct AppState* state) {
+    char path[PATH_LEN];
+    struct ChangeRecord record;
+    long long validRecords = 0;
+    long long logEndLsn = -1;
 
-    if (index == -1) {
-        printf("Appointment with ID %d not found.\n", id);
+    buildDataPath(state, CHANGE_LOG_FILE, path);
+    state->lastLsn = state->checkpointLsn;
+
+    FILE* fp = fopen(path, "rb");
+    if (fp != NULL) {
+        while (fread(&record, sizeof(record), 1, fp) == 1 && isValidChangeRecord(&record)) {
+            if (validRecords == 0) {
+                if (record.table != TABLE_LOG_HEADER) break;
+                state->logGeneration = record.generation;
+            }
+            logEndLsn = record.lsn;
+            validRecords++;
+        }
+        fclose(fp);
+    }
+
+    if (validRecords == 0 || logEndLsn != state->checkpointLsn) {
+        if (logEndLsn > state->lastLsn) state->lastLsn = logEndLsn; // Keep LSNs increasing
+        resetChangeLog(state);
         return;
     }
 
-     // Confirmation
-    char confirm[10];
-    printf("Are you sure you want to cancel appointment ID %d? (yes/no): ", id);
-    getStringInput("", confirm, sizeof(confirm)); // Blank prompt
-     if (strcmp(confirm, "yes") != 0) {
-        printf("Cancellation aborted.\n");
+    // Drop any torn record at the end before appending
+    fp = fopen(path, "r+b");
+    if (fp == NULL) {
+        perror("Error opening change log for appending");
         return;
     }
+    fseek(fp, (long)(validRecords * sizeof(struct ChangeRecord)), SEEK_SET);
+    state->changeLog = fp;
+    state->logRecords = (int)validRecords;
+}
 
-    // Shift elements to fill the gap
-    for (int i = index; i < state->appointmentCount - 1; i++) {
-        state->appointments[i] = state->appointments[i + 1];
+void closeChangeLog(struct AppState* state) {
+    if (state->changeLog != NULL) {
+        fclose(state->changeLog);
+        state->changeLog = NULL;
     }
-    state->appointmentCount--;
+}
 
-    printf("Appointment with ID %d cancelled successfully.\n", id);
+// --- Change Data Capture (Event Stream) ---
+// Every insert, update and delete of a patient, doctor, appointment or bill
+// is published as one JSON line to cdc.log, e.g.
+//   {"seq":42,"ts":1760000000,"branch":0,"table":"bill","op":"insert","id":7,"data":{...}}
+// Sequence numbers increase by one per event across restarts. The operator's
+// thread only copies the event into a bounded single-producer/single-consumer
+// ring (two atomic counters, no locks); a writer thread drains the ring in
+// batches with one write per batch. When the ring is full the event is
+// dropped instead of waiting. The next event that fits is preceded by a gap
+// line ("op":"gap", with the first and last lost sequence numbers), so a
+// consumer knows to resynchronise from the .dat files.
+// With --cdc-socket each batch is also sent, best effort, to a Unix socket.
+// Consumers read cdc.log from their saved byte offset (see --cdc-consume).
+
+// Event ops
+#define CDC_INSERT 1
+#define CDC_UPDATE 2
+#define CDC_DELETE 3
+#define CDC_GAP 4
+#define CDC_ARCHIVE 5 // Moved to the archive (cold tier), not deleted
+
+struct CdcEvent {
+    long long sequence;
+    long long timestamp;
+    int branchId;
+    int table;
+    int op;
+    int recordId;
+    long long gapFrom; // CDC_GAP: first lost sequence number (sequence is the last)
+    union {
+        struct Patient patient;
+        struct Doctor doctor;
+        struct Appointment appointment;
+        struct Bill bill;
+    } data;
+};
+
+struct CdcStream {
+    struct CdcEvent ring[CDC_RING_SIZE];
+    unsigned long long head;  // Next slot to fill (written by the producer only)
+    unsigned long long tail;  // Next slot to drain (written by the writer only)
+    long long nextSequence;   // Producer only
+    long long droppedFrom;    // Producer only: first sequence of the current gap
+    long long droppedCount;   // Producer only: events lost in the current gap
+    long long droppedTotal;
+    FILE* file;
+    char socketPath[PATH_LEN];
+    int socketFd;
+    struct TextBuffer socketRest; // Unsent end of a line the socket took only part of
+    int running;
+#ifdef HAVE_THREADS
+    pthread_t writer;
+    int writerStarted;
+#endif
+};
+
+char* cdcTableName(int table) {
+    switch (table) {
+        case TABLE_PATIENT: return "patient";
+        case TABLE_DOCTOR: return "doctor";
+        case TABLE_APPOINTMENT: return "appointment";
+        case TABLE_BILL: return "bill";
+    }
+    return "unknown";
 }
 
-// --- Billing Functions (Operate on AppState) ---
+char* cdcOpName(int op) {
+    switch (op) {
+        case CDC_INSERT: return "insert";
+        case CDC_UPDATE: return "update";
+        case CDC_DELETE: return "delete";
+        case CDC_GAP: return "gap";
+        case CDC_ARCHIVE: return "archive";
+    }
+    return "unknown";
+}
 
-int findBillById(struct AppState* state, int id) {
-    for (int i = 0; i < state->billCount; i++) {
-        if (state->bills[i].id == id) {
-            return i; // Return index
+int appendJsonString(struct TextBuffer* buf, char* text) {
+    int rc = appendText(buf, "\"");
+    for (unsigned char* c = (unsigned char*)text; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') rc |= appendText(buf, "\\%c", *c);
+        else if (*c < 0x20) rc |= appendText(buf, "\\u%04x", *c);
+        else rc |= appendText(buf, "%c", *c);
+    }
+    return rc | appendText(buf, "\"");
+}
+
+int formatCdcEvent(struct TextBuffer* buf, struct CdcEvent* e) {
+    int rc = appendText(buf, "{\"seq\":%lld,\"ts\":%lld,", e->sequence, e->timestamp);
+    if (e->op == CDC_GAP) {
+        return rc | appendText(buf, "\"op\":\"gap\",\"from\":%lld,\"dropped\":%lld}\n",
+                               e->gapFrom, e->sequence - e->gapFrom + 1);
+    }
+    rc |= appendText(buf, "\"branch\":%d,\"table\":\"%s\",\"op\":\"%s\",\"id\":%d,\"data\":",
+                     e->branchId, cdcTableName(e->table), cdcOpName(e->op), e->recordId);
+    if (e->op == CDC_DELETE) return rc | appendText(buf, "null}\n");
+
+    switch (e->table) {
+        case TABLE_PATIENT: {
+            struct Patient* p = &e->data.patient;
+            rc |= appendText(buf, "{\"id\":%d,\"name\":", p->id);
+            rc |= appendJsonString(buf, p->name);
+            rc |= appendText(buf, ",\"age\":%d,\"gender\":", p->age);
+            rc |= appendJsonString(buf, p->gender);
+            rc |= appendText(buf, ",\"disease\":");
+            rc |= appendJsonString(buf, p->disease);
+            rc |= appendText(buf, ",\"contact\":");
+            rc |= appendJsonString(buf, p->contact);
+            break;
+        }
+        case TABLE_DOCTOR: {
+            struct Doctor* d = &e->data.doctor;
+            rc |= appendText(buf, "{\"id\":%d,\"name\":", d->id);
+            rc |= appendJsonString(buf, d->name);
+            rc |= appendText(buf, ",\"specialization\":");
+            rc |= appendJsonString(buf, d->specialization);
+            rc |= appendText(buf, ",\"availability\":");
+            rc |= appendJsonString(buf, d->availability);
+            break;
+        }
+        case TABLE_APPOINTMENT: {
+            struct Appointment* a = &e->data.appointment;
+            rc |= appendText(buf, "{\"id\":%d,\"patient_id\":%d,\"doctor_id\":%d,\"date\":", a->id, a->patientId, a->doctorId);
+            rc |= appendJsonString(buf, a->date);
+            rc |= appendText(buf, ",\"time\":");
+            rc |= appendJsonString(buf, a->time);
+            break;
+        }
+        case TABLE_BILL: {
+            struct Bill* b = &e->data.bill;
+            rc |= appendText(buf, "{\"id\":%d,\"patient_id\":%d,\"doctor_id\":%d,\"doctor_fee\":%.2f,\"total_amount\":%.2f,\"date\":",
+                             b->id, b->patientId, b->doctorId, b->doctorFee, b->totalAmount);
+            rc |= appendJsonString(buf, b->dateGenerated);
+            break;
         }
     }
-    return -1; // Not found
+    return rc | appendText(buf, "}}\n");
 }
 
+#ifdef HAVE_THREADS
+void closeCdcSocket(struct CdcStream* stream) {
+    if (stream->socketFd >= 0) close(stream->socketFd);
+    stream->socketFd = -1;
+    stream->socketRest.length = 0; // A new connection starts on a line boundary
+}
 
-void generateBill(struct AppState* state) {
-    if (state->billCount >= MAX_BILLS) {
-        printf("Maximum bill limit reached.\n");
-        return;
+// Send what the socket takes without waiting. Returns the bytes sent (0 if it
+// is full), or -1 if the connection is gone.
+long sendCdcBytes(int fd, char* data, size_t length) {
+    ssize_t sent = send(fd, data, length, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (sent >= 0) return (long)sent;
+    return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+}
+#endif
+
+void sendCdcSocket(struct CdcStream* stream, struct TextBuffer* buf) {
+#ifdef HAVE_THREADS
+    if (stream->socketPath[0] == '\0') return;
+    if (stream->socketFd < 0) {
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        memcpy(address.sun_path, stream->socketPath, strlen(stream->socketPath) + 1); // Length checked at start
+        stream->socketFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (stream->socketFd < 0) return;
+        if (connect(stream->socketFd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+            closeCdcSocket(stream); // No listener right now; try again with the next batch
+            return;
+        }
+#ifdef SO_NOSIGPIPE
+        int on = 1; // A listener that goes away must not raise SIGPIPE
+        setsockopt(stream->socketFd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
     }
-     if (state->patientCount == 0) {
-        printf("No patients in the system to bill.\n");
+    // Never wait on the socket reader, but only ever hand it whole lines: the
+    // end of a line it took part of is sent first, and batches that arrive
+    // while it is still pending are skipped (the events stay in cdc.log)
+    struct TextBuffer* rest = &stream->socketRest;
+    if (rest->length > 0) {
+        long sent = sendCdcBytes(stream->socketFd, rest->data, rest->length);
+        if (sent < 0) {
+            closeCdcSocket(stream);
+            return;
+        }
+        memmove(rest->data, rest->data + sent, rest->length - sent);
+        rest->length -= sent;
+        if (rest->length > 0) return;
+    }
+    long sent = sendCdcBytes(stream->socketFd, buf->data, buf->length);
+    if (sent < 0) {
+        closeCdcSocket(stream);
         return;
     }
+    if ((size_t)sent < buf->length && sent > 0 && buf->data[sent - 1] != '\n') {
+        char* lineEnd = memchr(buf->data + sent, '\n', buf->length - sent);
+        size_t restLength = lineEnd != NULL ? (size_t)(lineEnd - buf->data) + 1 - sent : buf->length - sent;
+        if (appendText(rest, "%.*s", (int)restLength, buf->data + sent) != 0) closeCdcSocket(stream);
+    }
+#else
+    (void)stream;
+    (void)buf;
+#endif
+}
 
-    struct Bill b; // Use 'struct Bill'
-    b.id = state->nextBillId++;
-    int patientId, doctorId = -1;
-    int patientIndex, doctorIndex = -1;
-
-    printf("--- Generate New Bill ---\n");
-
-    // Get and validate Patient ID
-    viewPatients(state);
+// Write out everything in the ring, up to CDC_BATCH_EVENTS per write.
+// Only the writer thread (or, without threads, the producer) calls this.
+int drainCdcStream(struct CdcStream* stream) {
+    struct TextBuffer buf;
+    int drained = 0;
+    initTextBuffer(&buf);
     while (1) {
-        patientId = getIntInput("Enter Patient ID for the bill: ");
-        patientIndex = findPatientById(state, patientId);
-        if (patientIndex != -1) {
-            b.patientId = patientId;
-            break;
-        } else {
-            printf("Invalid Patient ID. Please try again.\n");
+        unsigned long long tail = stream->tail;
+        unsigned long long head = __atomic_load_n(&stream->head, __ATOMIC_ACQUIRE);
+        if (tail == head) break;
+        int batch = 0;
+        buf.length = 0;
+        while (tail != head && batch < CDC_BATCH_EVENTS) {
+            formatCdcEvent(&buf, &stream->ring[tail % CDC_RING_SIZE]);
+            tail++;
+            batch++;
         }
-    }
-
-    // Optionally, link to a specific doctor for the fee
-    char linkDoctor[5];
-    printf("Is this bill related to a specific doctor consultation? (yes/no): ");
-    getStringInput("", linkDoctor, sizeof(linkDoctor)); // Blank prompt
-    if(strcmp(linkDoctor, "yes") == 0 && state->doctorCount > 0) { // Check if doctors exist
-        viewDoctors(state);
-         while (1) {
-            doctorId = getIntInput("Enter Doctor ID for the consultation fee: ");
-            doctorIndex = findDoctorById(state, doctorId);
-            if (doctorIndex != -1) {
-                b.doctorId = doctorId;
-                break;
-            } else {
-                 printf("Invalid Doctor ID. Please try again.\n");
+        // The slots can be reused as soon as their events are formatted
+        __atomic_store_n(&stream->tail, tail, __ATOMIC_RELEASE);
+        if (buf.length > 0) {
+            if (stream->file != NULL) {
+                fwrite(buf.data, 1, buf.length, stream->file);
+                fflush(stream->file);
             }
+            sendCdcSocket(stream, &buf);
         }
-         b.doctorFee = getFloatInput("Enter Doctor Consultation Fee: ");
-    } else {
-        if(strcmp(linkDoctor, "yes") == 0 && state->doctorCount == 0) {
-            printf("Cannot link doctor fee, no doctors in the system.\n");
-        }
-        b.doctorId = -1; // Indicate no specific doctor linked or fee from doctor
-        b.doctorFee = 0.0;
+        drained += batch;
     }
+    freeTextBuffer(&buf);
+    return drained;
+}
 
-    // Get Bill Date
-    getStringInput("Enter Bill Date (YYYY-MM-DD): ", b.dateGenerated, DATE_LEN);
+#ifdef HAVE_THREADS
+void* cdcWriterMain(void* arg) {
+    struct CdcStream* stream = (struct CdcStream*)arg;
+    struct timespec pause = { 0, CDC_POLL_MS * 1000000L };
+    while (__atomic_load_n(&stream->running, __ATOMIC_ACQUIRE)) {
+        if (drainCdcStream(stream) == 0) nanosleep(&pause, NULL);
+    }
+    drainCdcStream(stream); // Whatever was published before the stop
+    return NULL;
+}
+#endif
+
+// Claim a ring slot, or NULL if the ring is full
+struct CdcEvent* reserveCdcSlot(struct CdcStream* stream, int needed) {
+    unsigned long long head = stream->head;
+    unsigned long long tail = __atomic_load_n(&stream->tail, __ATOMIC_ACQUIRE);
+    if (head - tail + needed > CDC_RING_SIZE) return NULL;
+    return &stream->ring[head % CDC_RING_SIZE];
+}
 
-    // Calculate Total
-    b.totalAmount = b.doctorFee; // Add other costs if implemented
+void commitCdcSlot(struct CdcStream* stream) {
+    __atomic_store_n(&stream->head, stream->head + 1, __ATOMIC_RELEASE);
+}
 
-    state->bills[state->billCount++] = b;
-    printf("Bill generated successfully for Patient %s (Bill ID: %d)\n",
-           state->patients[patientIndex].name, b.id);
-    printf("Total Amount: %.2f\n", b.totalAmount);
+// Queue the marker for events dropped since the last one that fit.
+// 'needed' slots must be free: the marker plus whatever follows it.
+int publishGap(struct CdcStream* stream, int needed) {
+    struct CdcEvent* gap = reserveCdcSlot(stream, needed);
+    if (gap == NULL) return -1;
+    memset(gap, 0, offsetof(struct CdcEvent, data));
+    gap->op = CDC_GAP;
+    gap->sequence = stream->nextSequence; // Last lost sequence number
+    gap->gapFrom = stream->droppedFrom;
+    gap->timestamp = (long long)time(NULL);
+    commitCdcSlot(stream);
+    stream->droppedCount = 0;
+    return 0;
 }
 
-void printInvoice(struct AppState* state) {
-    int billId = getIntInput("Enter Bill ID to print invoice: ");
-    int billIndex = findBillById(state, billId);
+// Publish one change. Never blocks: if the ring is full the event is counted
+// as lost and reported by a gap line ahead of the next event that fits.
+void publishChange(struct AppState* state, int table, int op, int recordId, void* data, size_t dataSize) {
+    struct CdcStream* stream = state->cdc;
+    if (stream == NULL) return;
 
-    if (billIndex == -1) {
-        printf("Bill with ID %d not found.\n", billId);
+    if (stream->droppedCount > 0 && publishGap(stream, 2) != 0) {
+        stream->nextSequence++;
+        stream->droppedCount++;
+        stream->droppedTotal++;
         return;
     }
+    long long sequence = ++stream->nextSequence;
+    long long now = (long long)time(NULL);
+
+    struct CdcEvent* e = reserveCdcSlot(stream, 1);
+    if (e == NULL) {
+        stream->droppedFrom = sequence;
+        stream->droppedCount = 1;
+        stream->droppedTotal++;
+        return;
+    }
+    e->sequence = sequence;
+    e->timestamp = now;
+    e->branchId = state->branchId;
+    e->table = table;
+    e->op = op;
+    e->recordId = recordId;
+    e->gapFrom = 0;
+    if (data != NULL) memcpy(&e->data, data, dataSize);
+    commitCdcSlot(stream);
+#ifndef HAVE_THREADS
+    drainCdcStream(stream); // No writer thread: write through
+#endif
+}
 
-    struct Bill b = state->bills[billIndex];
-    int patientIndex = findPatientById(state, b.patientId);
-
-    if (patientIndex == -1) {
-        printf("Error: Patient associated with this bill (ID: %d) not found!\n", b.patientId);
-        return; // Cannot print invoice without patient details
+// Sequence number of the last line of cdc.log (0 if empty or missing)
+long long lastCdcSequence(FILE* fp) {
+    char tail[CDC_TAIL_BYTES + 1];
+    long long sequence = 0;
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    long start = size > CDC_TAIL_BYTES ? size - CDC_TAIL_BYTES : 0;
+    fseek(fp, start, SEEK_SET);
+    size_t n = fread(tail, 1, size - start, fp);
+    tail[n] = '\0';
+    for (char* line = strstr(tail, "{\"seq\":"); line != NULL; line = strstr(line + 1, "\n{\"seq\":")) {
+        if (*line == '\n') line++;
+        long long value;
+        if (sscanf(line, "{\"seq\":%lld", &value) == 1 && value > sequence) sequence = value;
     }
-    struct Patient p = state->patients[patientIndex];
-    char* doctorName = (b.doctorId != -1) ? getDoctorNameById(state, b.doctorId) : "N/A";
+    return sequence;
+}
 
+struct CdcStream* startCdcStream(char* socketPath) {
+    struct CdcStream* stream = calloc(1, sizeof(struct CdcStream));
+    if (stream == NULL) return NULL;
+    stream->socketFd = -1;
+    if (socketPath != NULL) {
+#ifdef HAVE_THREADS
+        struct sockaddr_un address;
+        if (strlen(socketPath) >= sizeof(address.sun_path)) {
+            printf("Error: Change stream socket path is longer than %d characters; not using it.\n",
+                   (int)sizeof(address.sun_path) - 1);
+            socketPath = NULL;
+        }
+#endif
+        if (socketPath != NULL) snprintf(stream->socketPath, PATH_LEN, "%s", socketPath);
+#ifdef CDC_IGNORE_SIGPIPE
+        if (socketPath != NULL) signal(SIGPIPE, SIG_IGN);
+#endif
+    }
 
-    printf("\n\n--- HOSPITAL INVOICE ---\n");
-    printf("----------------------------------------\n");
-    printf(" Bill ID       : %d\n", b.id);
-    printf(" Bill Date     : %s\n", b.dateGenerated);
-    printf("----------------------------------------\n");
-    printf(" Patient Details:\n");
-    printf("   Patient ID  : %d\n", p.id);
-    printf("   Name        : %s\n", p.name);
-    printf("   Age         : %d\n", p.age);
-    printf("   Gender      : %s\n", p.gender);
-    printf("   Contact     : %s\n", p.contact);
-    printf("----------------------------------------\n");
-    printf(" Charges:\n");
-    if (b.doctorId != -1) {
-       printf("   Doctor Fee (Dr. %s): %.2f\n", doctorName, b.doctorFee);
+    stream->file = fopen(CDC_FILE, "a+b");
+    if (stream->file == NULL) {
+        perror("Error opening change stream file");
+    } else {
+        stream->nextSequence = lastCdcSequence(stream->file);
+        fseek(stream->file, 0, SEEK_END);
     }
-    // Add lines for medicine, tests etc. if implemented
-    printf("----------------------------------------\n");
-    printf(" Total Amount  : %.2f\n", b.totalAmount);
-    printf("----------------------------------------\n");
-    printf(" Thank you!\n");
-    printf("----------------------------------------\n\n");
+    stream->running = 1;
+#ifdef HAVE_THREADS
+    stream->writerStarted = pthread_create(&stream->writer, NULL, cdcWriterMain, stream) == 0;
+    if (!stream->writerStarted) {
+        printf("Warning: Change stream writer could not start; events are not published.\n");
+        if (stream->file != NULL) fclose(stream->file);
+        free(stream);
+        return NULL;
+    }
+#endif
+    return stream;
 }
 
-void viewBills(struct AppState* state) {
-    printf("\n--- Bill List (%d) ---\n", state->billCount);
-    if (state->billCount == 0) {
-        printf("No bills generated yet.\n");
-        return;
+void stopCdcStream(struct CdcStream* stream) {
+    if (stream == NULL) return;
+    __atomic_store_n(&stream->running, 0, __ATOMIC_RELEASE);
+#ifdef HAVE_THREADS
+    if (stream->writerStarted) pthread_join(stream->writer, NULL);
+#endif
+    drainCdcStream(stream);
+    if (stream->droppedCount > 0 && publishGap(stream, 1) == 0) {
+        drainCdcStream(stream); // Consumers still see that the tail was lost
     }
-    printf("-----------------------------------------------------------------------------\n");
-    printf("Bill ID | Patient ID | Patient Name       | Doctor Fee | Total Amount | Date \n");
-    printf("-----------------------------------------------------------------------------\n");
-    for (int i = 0; i < state->billCount; i++) {
-         char* patientName = getPatientNameById(state, state->bills[i].patientId);
-        printf("%-7d | %-10d | %-18s | %-10.2f | %-12.2f | %-10s\n",
-               state->bills[i].id,
-               state->bills[i].patientId,
-               patientName,
-               state->bills[i].doctorFee,
-               state->bills[i].totalAmount,
-               state->bills[i].dateGenerated);
+#ifdef HAVE_THREADS
+    // Give the reader a moment to take the end of a cut line before closing
+    struct timespec pause = { 0, CDC_POLL_MS * 1000000L };
+    for (int tries = 0; tries < CDC_CLOSE_TRIES && stream->socketFd >= 0 && stream->socketRest.length > 0; tries++) {
+        struct TextBuffer none = { NULL, 0, 0 };
+        sendCdcSocket(stream, &none);
+        if (stream->socketRest.length > 0) nanosleep(&pause, NULL);
     }
-     printf("-----------------------------------------------------------------------------\n");
+    closeCdcSocket(stream); // Only after the last send
+#endif
+    freeTextBuffer(&stream->socketRest);
+    if (stream->droppedTotal > 0) {
+        printf("Warning: %lld change event(s) were dropped because the stream fell behind.\n", stream->droppedTotal);
+    }
+    if (stream->file != NULL) fclose(stream->file);
+    free(stream);
 }
 
+// Consumer offsets (text): name|byte offset in cdc.log|last sequence read
+int loadCdcOffset(char* consumer, long* offset, long long* sequence) {
+    char line[NAME_LEN + 64], name[NAME_LEN];
+    long savedOffset;
+    long long savedSequence;
+    *offset = 0;
+    *sequence = 0;
+    FILE* fp = fopen(CDC_OFFSET_FILE, "r");
+    if (fp == NULL) return -1;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (sscanf(line, "%99[^|]|%ld|%lld", name, &savedOffset, &savedSequence) == 3 && strcmp(name, consumer) == 0) {
+            *offset = savedOffset;
+            *sequence = savedSequence;
+            fclose(fp);
+            return 0;
+        }
+    }
+    fclose(fp);
+    return -1;
+}
 
-// --- Menu Functions (Now require AppState pointer) ---
+// Replace this consumer's line, keeping the others (write a copy, then rename)
+int saveCdcOffset(char* consumer, long offset, long long sequence) {
+    char line[NAME_LEN + 64], name[NAME_LEN];
+    char tempPath[PATH_LEN];
+    snprintf(tempPath, sizeof(tempPath), "%s.tmp", CDC_OFFSET_FILE);
+    FILE* out = fopen(tempPath, "w");
+    if (out == NULL) {
+        perror("Error writing consumer offsets");
+        return -1;
+    }
+    FILE* in = fopen(CDC_OFFSET_FILE, "r");
+    if (in != NULL) {
+        while (fgets(line, sizeof(line), in) != NULL) {
+            if (sscanf(line, "%99[^|]|", name) == 1 && strcmp(name, consumer) != 0) fputs(line, out);
+        }
+        fclose(in);
+    }
+    fprintf(out, "%s|%ld|%lld\n", consumer, offset, sequence);
+    if (fclose(out) != 0) {
+        perror("Error writing consumer offsets");
+        return -1;
+    }
+    return replaceFile(tempPath, CDC_OFFSET_FILE);
+}
+
+// Print the events a consumer has not seen yet (at most maxEvents, 0 = all)
+// and commit its new offset. Only complete lines are consumed.
+int consumeCdcEvents(char* consumer, int maxEvents) {
+    char line[CDC_MAX_LINE];
+    long offset;
+    long long sequence;
+    int count = 0;
+    if (strchr(consumer, '|') != NULL || consumer[0] == '\0') {
+        fprintf(stderr, "Consumer name must be non-empty and must not contain '|'.\n");
+        return 1;
+    }
+    loadCdcOffset(consumer, &offset, &sequence);
+
+    FILE* fp = fopen(CDC_FILE, "rb");
+    if (fp == NULL) {
+        fprintf(stderr, "No change stream (%s) yet.\n", CDC_FILE);
+        return 1;
+    }
+    fseek(fp, 0, SEEK_END);
+    if (ftell(fp) < offset) {
+        fprintf(stderr, "Warning: %s is shorter than the saved offset; reading from the start.\n", CDC_FILE);
+        offset = 0;
+    }
+    fseek(fp, offset, SEEK_SET);
+    while ((maxEvents == 0 || count < maxEvents) && fgets(line, sizeof(line), fp) != NULL) {
+        size_t len = strlen(line);
+        if (len == 0 || line[len - 1] != '\n') break; // Being written right now: next time
+        long long value;
+        if (sscanf(line, "{\"seq\":%lld", &value) == 1) sequence = value;
+        fputs(line, stdout);
+        offset += (long)len;
+        count++;
+    }
+    fclose(fp);
+    if (saveCdcOffset(consumer, offset, sequence) != 0) return 1;
+    fprintf(stderr, "Consumer '%s': %d event(s), now at sequence %lld (offset %ld).\n", consumer, count, sequence, offset);
+    return 0;
+}
+
+// --- Patient History ---
+// editPatient used to overwrite records in place. Every add, edit and delete
+// now appends a version to the patient's chain. Edits store only the changed
+// fields; every HISTORY_FULL_EVERY versions a full image is stored instead, so
+// rebuilding any version decodes one full image and fewer than
+// HISTORY_FULL_EVERY deltas.
+//
+// Payload encoding: one byte with a bit per field present, then each present
+// field in order (strings as a length byte plus the characters, age as an int).
+
+#define VERSION_FULL 1
+#define VERSION_DELTA 2
+#define VERSION_DELETED 3
+
+#define FIELD_NAME 0x01
+#define FIELD_AGE 0x02
+#define FIELD_GENDER 0x04
+#define FIELD_DISEASE 0x08
+#define FIELD_CONTACT 0x10
+
+int encodeString(unsigned char* out, char* text, int maxLen) {
+    int len = 0;
+    while (len < maxLen - 1 && text[len] != '\0') len++;
+    out[0] = (unsigned char)len;
+    memcpy(out + 1, text, len);
+    return len + 1;
+}
+
+int decodeString(unsigned char* in, char* text) {
+    int len = in[0];
+    memcpy(text, in + 1, len);
+    text[len] = '\0';
+    return len + 1;
+}
+
+// Encode the fields of after that differ from before (all fields if before is NULL).
+// Returns the payload length; out[0] is 0 if nothing changed.
+int encodePatientFields(struct Patient* before, struct Patient* after, unsigned char* out) {
+    int mask = 0;
+    int n = 1;
+    if (before == NULL || strcmp(before->name, after->name) != 0) {
+        mask |= FIELD_NAME;
+        n += encodeString(out + n, after->name, NAME_LEN);
+    }
+    if (before == NULL || before->age != after->age) {
+        mask |= FIELD_AGE;
+        memcpy(out + n, &after->age, sizeof(int));
+        n += sizeof(int);
+    }
+    if (before == NULL || strcmp(before->gender, after->gender) != 0) {
+        mask |= FIELD_GENDER;
+        n += encodeString(out + n, after->gender, GENDER_LEN);
+    }
+    if (before == NULL || strcmp(before->disease, after->disease) != 0) {
+        mask |= FIELD_DISEASE;
+        n += encodeString(out + n, after->disease, DISEASE_LEN);
+    }
+    if (before == NULL || strcmp(before->contact, after->contact) != 0) {
+        mask |= FIELD_CONTACT;
+        n += encodeString(out + n, after->contact, CONTACT_LEN);
+    }
+    out[0] = (unsigned char)mask;
+    return n;
+}
+
+void decodePatientFields(unsigned char* in, struct Patient* p) {
+    int mask = in[0];
+    int n = 1;
+    if (mask & FIELD_NAME) n += decodeString(in + n, p->name);
+    if (mask & FIELD_AGE) {
+        memcpy(&p->age, in + n, sizeof(int));
+        n += sizeof(int);
+    }
+    if (mask & FIELD_GENDER) n += decodeString(in + n, p->gender);
+    if (mask & FIELD_DISEASE) n += decodeString(in + n, p->disease);
+    if (mask & FIELD_CONTACT) n += decodeString(in + n, p->contact);
+}
+
+// Hash slot for a patient ID (the slot holding it, or the empty slot where it would go)
+int historyHeadSlot(struct PatientHistory* history, int patientId) {
+    unsigned int slot = ((unsigned int)patientId * 2654435761u) & (HISTORY_HEAD_SLOTS - 1);
+    for (int probes = 0; probes < HISTORY_HEAD_SLOTS; probes++) {
+        if (history->headId[slot] == patientId || history->headId[slot] == 0) return (int)slot;
+        slot = (slot + 1) & (HISTORY_HEAD_SLOTS - 1);
+    }
+    return -1; // Table full (cannot happen: there are fewer chains than versions)
+}
+
+// Newest version of a patient, or -1 if there is no history
+int findHistoryHead(struct PatientHistory* history, int patientId) {
+    int slot = historyHeadSlot(history, patientId);
+    if (slot == -1 || history->headId[slot] != patientId) return -1;
+    return history->headVersion[slot];
+}
+
+// Versions are appended in time order, so the last one seen per patient is its head
+void rebuildHistoryHeads(struct PatientHistory* history) {
+    memset(history->headId, 0, sizeof(history->headId));
+    for (int v = 0; v < history->versionCount; v++) {
+        int slot = historyHeadSlot(history, history->versions[v].patientId);
+        if (slot == -1) continue;
+        history->headId[slot] = history->versions[v].patientId;
+        history->headVersion[slot] = v;
+    }
+}
+
+// Append a version. before == NULL records a new patient, after == NULL a deletion.
+// Returns 0 on success, 1 if nothing changed, -1 if the store is full.
+int appendPatientVersion(struct PatientHistory* history, int patientId, struct Patient* before,
+                         struct Patient* after, long long timestamp) {
+    unsigned char payload[1 + NAME_LEN + sizeof(int) + GENDER_LEN + DISEASE_LEN + CONTACT_LEN + 4];
+    int head = findHistoryHead(history, patientId);
+    int kind, length = 0;
+
+    if (after == NULL) {
+        kind = VERSION_DELETED;
+    } else {
+        length = encodePatientFields(before, after, payload);
+        if (payload[0] == 0) return 1;
+        kind = VERSION_DELTA;
+        if (head == -1 || history->versions[head].kind == VERSION_DELETED
+            || history->versions[head].sinceFull + 1 >= HISTORY_FULL_EVERY) {
+            kind = VERSION_FULL;
+            length = encodePatientFields(NULL, after, payload);
+        }
+    }
+
+    int slot = historyHeadSlot(history, patientId);
+    if (history->versionCount >= MAX_HISTORY_VERSIONS || history->dataUsed + length > HISTORY_DATA_SIZE
+        || slot == -1) {
+        return -1;
+    }
+
+    int v = history->versionCount++;
+    struct PatientVersion* version = &history->versions[v];
+    version->patientId = patientId;
+    version->kind = kind;
+    version->timestamp = timestamp;
+    version->previous = head;
+    version->next = -1;
+    version->offset = history->dataUsed;
+    version->length = length;
+    memcpy(history->data + history->dataUsed, payload, length);
+    history->dataUsed += length;
+
+    if (kind == VERSION_DELTA) {
+        version->base = history->versions[head].base;
+        version->previousFull = history->versions[head].previousFull;
+        version->sinceFull = history->versions[head].sinceFull + 1;
+    } else {
+        version->base = v;
+        version->previousFull = (head != -1) ? history->versions[head].base : -1;
+        version->sinceFull = 0;
+    }
+    if (head != -1) history->versions[head].next = v;
+    history->headId[slot] = patientId;
+    history->headVersion[slot] = v;
+    return 0;
+}
+
+// Rebuild the record as of version v. Returns 0 if the patient was deleted at v.
+int materializeVersion(struct PatientHistory* history, int v, struct Patient* out) {
+    struct PatientVersion* version = &history->versions[v];
+    if (version->kind == VERSION_DELETED) return 0;
+    memset(out, 0, sizeof(struct Patient));
+    out->id = version->patientId;
+    for (int step = version->base; ; step = history->versions[step].next) {
+        decodePatientFields(history->data + history->versions[step].offset, out);
+        if (step == v) break;
+    }
+    return 1;
+}
+
+// Newest version of a patient made at or before timestamp, or -1 if none.
+// Skips back a full image at a time, then forward over at most
+// HISTORY_FULL_EVERY - 1 deltas.
+int findVersionAsOf(struct PatientHistory* history, int patientId, long long timestamp) {
+    int head = findHistoryHead(history, patientId);
+    if (head == -1) return -1;
+    int full = history->versions[head].base;
+    while (full != -1 && history->versions[full].timestamp > timestamp) {
+        full = history->versions[full].previousFull;
+    }
+    if (full == -1) return -1;
+    int v = full;
+    while (history->versions[v].next != -1) {
+        struct PatientVersion* newer = &history->versions[history->versions[v].next];
+        if (newer->timestamp > timestamp || newer->base != full) break;
+        v = history->versions[v].next;
+    }
+    return v;
+}
+
+// Patient as of a point in time. Returns 1 and fills out if the patient existed then.
+int getPatientAsOf(struct AppState* state, int patientId, long long timestamp, struct Patient* out) {
+    int v = findVersionAsOf(&state->history, patientId, timestamp);
+    if (v == -1) return 0;
+    return materializeVersion(&state->history, v, out);
+}
+
+// Retention: drop versions made before cutoff. For each patient the state as
+// of the cutoff is kept as a full image, so reads at or after it are unchanged.
+// Patients deleted before the cutoff disappear from the history.
+// Returns the number of versions removed, or -1 if out of memory.
+int trimPatientHistory(struct AppState* state, long long cutoff) {
+    struct PatientHistory* old = &state->history;
+    struct PatientHistory* trimmed = malloc(sizeof(struct PatientHistory));
+    if (trimmed == NULL) return -1;
+    trimmed->versionCount = 0;
+    trimmed->dataUsed = 0;
+    memset(trimmed->headId, 0, sizeof(trimmed->headId));
+
+    // Re-record each chain, patients in order of first appearance
+    for (int first = 0; first < old->versionCount; first++) {
+        if (old->versions[first].previous != -1) continue; // Not the start of a chain
+        struct Patient current, previous;
+        int havePrevious = 0;
+        int pivot = findVersionAsOf(old, old->versions[first].patientId, cutoff);
+
+        int v = (pivot != -1) ? pivot : first;
+        for (; v != -1; v = old->versions[v].next) {
+            int exists = materializeVersion(old, v, &current);
+            if (v == pivot && !exists) break; // Deleted before the cutoff: drop the chain
+            appendPatientVersion(trimmed, old->versions[v].patientId,
+                                 havePrevious ? &previous : NULL, exists ? &current : NULL,
+                                 old->versions[v].timestamp);
+            previous = current;
+            havePrevious = exists;
+        }
+    }
+
+    int removed = old->versionCount - trimmed->versionCount;
+    memcpy(old, trimmed, sizeof(struct PatientHistory));
+    free(trimmed);
+    return removed;
+}
+
+// Record a version of a patient; trims old history if the store is full
+void recordPatientVersion(struct AppState* state, int patientId, struct Patient* before, struct Patient* after) {
+    struct PatientHistory* history = &state->history;
+    long long now = (long long)time(NULL);
+
+    // Patients that existed before history was kept get their prior values as a base
+    if (before != NULL && findHistoryHead(history, patientId) == -1) {
+        appendPatientVersion(history, patientId, NULL, before, 0);
+    }
+    if (appendPatientVersion(history, patientId, before, after, now) == -1) {
+        trimPatientHistory(state, now - (long long)HISTORY_DEFAULT_RETENTION_DAYS * 86400);
+        if (appendPatientVersion(history, patientId, before, after, now) == -1) {
+            printf("Warning: Patient history is full; this change was not recorded in the history.\n");
+        }
+    }
+}
+
+// Parse "YYYY-MM-DD HH:MM" (or just the date, meaning end of that day) as local time
+long long parseDateTime(char* text) {
+    int year, month, day, hour = 23, minute = 59;
+    int fields = sscanf(text, "%d-%d-%d %d:%d", &year, &month, &day, &hour, &minute);
+    if (fields != 3 && fields != 5) return -1;
+    struct tm when;
+    memset(&when, 0, sizeof(when));
+    when.tm_year = year - 1900;
+    when.tm_mon = month - 1;
+    when.tm_mday = day;
+    when.tm_hour = hour;
+    when.tm_min = minute;
+    when.tm_sec = (fields == 3) ? 59 : 0;
+    when.tm_isdst = -1;
+    return (long long)mktime(&when);
+}
+
+void formatTimestamp(long long timestamp, char* out, int len) {
+    if (timestamp == 0) {
+        snprintf(out, len, "(before history)");
+        return;
+    }
+    time_t t = (time_t)timestamp;
+    strftime(out, len, "%Y-%m-%d %H:%M:%S", localtime(&t));
+}
+
+void viewPatientHistory(struct AppState* state) {
+    struct PatientHistory* history = &state->history;
+    int id = getIntInput("Enter Patient ID: ");
+    int head = findHistoryHead(history, id);
+    if (head == -1) {
+        printf("No history recorded for patient ID %d.\n", id);
+        return;
+    }
+
+    // Find the oldest version, then list forward
+    int oldest = head, count = 1;
+    while (history->versions[oldest].previous != -1) {
+        oldest = history->versions[oldest].previous;
+        count++;
+    }
+
+    printf("\n--- History of Patient ID %d (%d versions) ---\n", id, count);
+    printf("-----------------------------------------------------------------------------------\n");
+    printf("When                | Type    | Bytes | Changed Fields\n");
+    printf("-----------------------------------------------------------------------------------\n");
+    for (int v = oldest; v != -1; v = history->versions[v].next) {
+        struct PatientVersion* version = &history->versions[v];
+        char when[32];
+        char fields[64] = "";
+        formatTimestamp(version->timestamp, when, sizeof(when));
+        if (version->kind != VERSION_DELETED) {
+            int mask = history->data[version->offset];
+            if (mask & FIELD_NAME) strcat(fields, "name ");
+            if (mask & FIELD_AGE) strcat(fields, "age ");
+            if (mask & FIELD_GENDER) strcat(fields, "gender ");
+            if (mask & FIELD_DISEASE) strcat(fields, "disease ");
+            if (mask & FIELD_CONTACT) strcat(fields, "contact");
+        }
+        printf("%-19s | %-7s | %-5d | %s\n", when,
+               version->kind == VERSION_FULL ? "Full" : (version->kind == VERSION_DELTA ? "Delta" : "Deleted"),
+               version->length, fields);
+    }
+    printf("-----------------------------------------------------------------------------------\n");
+}
+
+void viewPatientAsOf(struct AppState* state) {
+    char text[32];
+    struct Patient p;
+    int id = getIntInput("Enter Patient ID: ");
+    getStringInput("As of (YYYY-MM-DD or YYYY-MM-DD HH:MM): ", text, sizeof(text));
+    long long when = parseDateTime(text);
+    if (when == -1) {
+        printf("Invalid date/time.\n");
+        return;
+    }
+    if (!getPatientAsOf(state, id, when, &p)) {
+        printf("Patient ID %d did not exist at %s (or has no recorded history).\n", id, text);
+        return;
+    }
+    printf("\n--- Patient ID %d as of %s ---\n", id, text);
+    printf(" Name     : %s\n", p.name);
+    printf(" Age      : %d\n", p.age);
+    printf(" Gender   : %s\n", p.gender);
+    printf(" Disease  : %s\n", p.disease);
+    printf(" Contact  : %s\n", p.contact);
+}
+
+void trimHistoryMenu(struct AppState* state) {
+    int days = getIntInput("Keep history for how many days? ");
+    if (days < 0) {
+        printf("Days cannot be negative.\n");
+        return;
+    }
+    int before = state->history.dataUsed;
+    int removed = trimPatientHistory(state, (long long)time(NULL) - (long long)days * 86400);
+    if (removed < 0) {
+        printf("Error: Not enough memory to trim history.\n");
+        return;
+    }
+    printf("Removed %d version(s); history now uses %d of %d bytes (was %d).\n",
+           removed, state->history.dataUsed, HISTORY_DATA_SIZE, before);
+}
+
+// --- Patient Name Index ---
+// Finds patients by name despite typos. Names are lower-cased with single
+// spaces, and the full name plus each word is inserted into a BK-tree, so
+// "shahid", "amin" and "shahid amin" all find the same patient. A search only
+// descends into children whose parent distance is within the current radius,
+// which shrinks as better matches are found.
+
+// Lower-case, trim and collapse spaces (ctype.h is not used in this program)
+void normalizeName(char* text, char* out) {
+    int n = 0;
+    for (int i = 0; text[i] != '\0' && n < NAME_LEN - 1; i++) {
+        char c = text[i];
+        if (c >= 'A' && c <= 'Z') c = c - 'A' + 'a';
+        if (c == ' ' || c == '\t') {
+            if (n == 0 || out[n - 1] == ' ') continue;
+            c = ' ';
+        }
+        out[n++] = c;
+    }
+    if (n > 0 && out[n - 1] == ' ') n--;
+    out[n] = '\0';
+}
+
+// Levenshtein distance, two rows
+int editDistance(char* a, char* b) {
+    int lenA = strlen(a), lenB = strlen(b);
+    int rowA[NAME_LEN + 1], rowB[NAME_LEN + 1];
+    int* previous = rowA;
+    int* current = rowB;
+    for (int j = 0; j <= lenB; j++) previous[j] = j;
+    for (int i = 1; i <= lenA; i++) {
+        current[0] = i;
+        for (int j = 1; j <= lenB; j++) {
+            int cost = (a[i - 1] == b[j - 1]) ? 0 : 1;
+            int best = previous[j - 1] + cost;
+            if (previous[j] + 1 < best) best = previous[j] + 1;
+            if (current[j - 1] + 1 < best) best = current[j - 1] + 1;
+            current[j] = best;
+        }
+        int* swap = previous;
+        previous = current;
+        current = swap;
+    }
+    return previous[lenB];
+}
+
+// Insert one key. Returns -1 if the node pool is full.
+int insertNameKey(struct NameIndex* index, char* key, int patientId) {
+    if (key[0] == '\0') return 0;
+    if (index->nodeCount >= NAME_INDEX_NODES) return -1;
+
+    int n = index->nodeCount++;
+    struct NameIndexNode* node = &index->nodes[n];
+    node->patientId = patientId;
+    node->deleted = 0;
+    node->parentDistance = 0;
+    node->firstChild = -1;
+    node->nextSibling = -1;
+    snprintf(node->key, NAME_LEN, "%s", key);
+    if (n == 0) return 0; // Root
+
+    int at = 0;
+    while (1) {
+        int distance = editDistance(key, index->nodes[at].key);
+        int child = index->nodes[at].firstChild;
+        while (child != -1 && index->nodes[child].parentDistance != distance) {
+            child = index->nodes[child].nextSibling;
+        }
+        if (child == -1) {
+            node->parentDistance = distance;
+            node->nextSibling = index->nodes[at].firstChild;
+            index->nodes[at].firstChild = n;
+            return 0;
+        }
+        at = child;
+    }
+}
+
+// Keys for a name: the full normalized name, then its words
+int nameKeys(char* name, char keys[NAME_INDEX_TOKENS][NAME_LEN]) {
+    char normalized[NAME_LEN];
+    normalizeName(name, normalized);
+    int count = 0;
+    snprintf(keys[count++], NAME_LEN, "%s", normalized);
+    if (strchr(normalized, ' ') == NULL) return count; // Single word: already indexed
+
+    char* word = normalized;
+    while (*word != '\0' && count < NAME_INDEX_TOKENS) {
+        char* end = strchr(word, ' ');
+        int len = end ? (int)(end - word) : (int)strlen(word);
+        snprintf(keys[count++], NAME_LEN, "%.*s", len, word);
+        if (end == NULL) break;
+        word = end + 1;
+    }
+    return count;
+}
+
+void rebuildNameIndex(struct AppState* state) {
+    struct NameIndex* index = &state->nameIndex;
+    char keys[NAME_INDEX_TOKENS][NAME_LEN];
+    index->nodeCount = 0;
+    index->deletedCount = 0;
+    for (int i = 0; i < state->patientCount; i++) {
+        int keyCount = nameKeys(state->patients[i].name, keys);
+        for (int k = 0; k < keyCount; k++) {
+            insertNameKey(index, keys[k], state->patients[i].id);
+        }
+    }
+}
+
+void indexPatientName(struct AppState* state, struct Patient* p) {
+    struct NameIndex* index = &state->nameIndex;
+    char keys[NAME_INDEX_TOKENS][NAME_LEN];
+    int keyCount = nameKeys(p->name, keys);
+    if (index->nodeCount + keyCount > NAME_INDEX_NODES) {
+        rebuildNameIndex(state); // Reclaims deleted nodes (includes p if already stored)
+        if (findPatientById(state, p->id) != -1) return;
+    }
+    for (int k = 0; k < keyCount; k++) {
+        insertNameKey(index, keys[k], p->id);
+    }
+}
+
+// Mark a patient's keys deleted; rebuild once deleted nodes outnumber live ones
+void unindexPatientName(struct AppState* state, int patientId) {
+    struct NameIndex* index = &state->nameIndex;
+    for (int n = 0; n < index->nodeCount; n++) {
+        if (index->nodes[n].patientId == patientId && !index->nodes[n].deleted) {
+            index->nodes[n].deleted = 1;
+            index->deletedCount++;
+        }
+    }
+    if (index->deletedCount * 2 > index->nodeCount) {
+        rebuildNameIndex(state);
+    }
+}
+
+struct NameMatch {
+    int patientId;
+    int distance;
+};
+
+// Keep the best matches sorted by distance then ID, one entry per patient
+void offerNameMatch(struct NameMatch* matches, int* count, int limit, int patientId, int distance) {
+    for (int i = 0; i < *count; i++) {
+        if (matches[i].patientId == patientId) {
+            if (matches[i].distance <= distance) return;
+            // Better match for the same patient: remove and re-insert
+            for (int j = i; j < *count - 1; j++) matches[j] = matches[j + 1];
+            (*count)--;
+            break;
+        }
+    }
+    int pos = *count;
+    while (pos > 0 && (matches[pos - 1].distance > distance
+                       || (matches[pos - 1].distance == distance && matches[pos - 1].patientId > patientId))) {
+        pos--;
+    }
+    if (pos >= limit) return;
+    if (*count == limit) (*count)--;
+    for (int j = *count; j > pos; j--) matches[j] = matches[j - 1];
+    matches[pos].patientId = patientId;
+    matches[pos].distance = distance;
+    (*count)++;
+}
+
+// Closest patients to a (possibly misspelt) name, up to limit, within a typo
+// budget that grows with the length of the query. Returns the number found.
+int searchPatientsByName(struct AppState* state, char* query, struct NameMatch* matches, int limit) {
+    struct NameIndex* index = &state->nameIndex;
+    char key[NAME_LEN];
+    int stack[NAME_INDEX_NODES];
+    int top = 0, count = 0;
+
+    normalizeName(query, key);
+    int len = strlen(key);
+    if (len == 0 || index->nodeCount == 0) return 0;
+    int maxDistance = (len <= 4) ? 1 : (len <= 8) ? 2 : 3;
+
+    stack[top++] = 0;
+    while (top > 0) {
+        int n = stack[--top];
+        struct NameIndexNode* node = &index->nodes[n];
+        int distance = editDistance(key, node->key);
+        if (!node->deleted && distance <= maxDistance) {
+            offerNameMatch(matches, &count, limit, node->patientId, distance);
+        }
+        // Once the list is full only strictly better matches can change it
+        int radius = (count == limit) ? matches[count - 1].distance - 1 : maxDistance;
+        if (radius < 0) continue;
+        for (int child = node->firstChild; child != -1; child = index->nodes[child].nextSibling) {
+            int d = index->nodes[child].parentDistance;
+            if (d >= distance - radius && d <= distance + radius) {
+                stack[top++] = child;
+            }
+        }
+    }
+    return count;
+}
+
+void printNameMatches(struct AppState* state, struct NameMatch* matches, int count) {
+    printf("-----------------------------------------------------------------------------------\n");
+    printf("ID   | Name                 | Age | Gender   | Contact        | Typos\n");
+    printf("-----------------------------------------------------------------------------------\n");
+    for (int i = 0; i < count; i++) {
+        int index = findPatientById(state, matches[i].patientId);
+        if (index == -1) continue;
+        struct Patient* p = &state->patients[index];
+        printf("%-4d | %-20s | %-3d | %-8s | %-14s | %d\n",
+               p->id, p->name, p->age, p->gender, p->contact, matches[i].distance);
+    }
+    printf("-----------------------------------------------------------------------------------\n");
+}
+
+// Ask for a patient by ID or by name; a name shows the closest matches to pick
+// from. Returns the patient's index in patients[], or -1 if the input is blank
+// (or ends) or the only match is declined.
+int promptForPatient(struct AppState* state, char* prompt) {
+    char input[NAME_LEN];
+    struct NameMatch matches[NAME_SEARCH_RESULTS];
+    while (1) {
+        int id;
+        char extra;
+        getStringInput(prompt, input, NAME_LEN);
+        if (input[0] == '\0') return -1; // Blank line or end of input: give up
+        if (sscanf(input, "%d %c", &id, &extra) == 1) {
+            int index = findPatientById(state, id);
+            if (index != -1) return index;
+            printf("Invalid Patient ID. Please try again.\n");
+            continue;
+        }
+        int count = searchPatientsByName(state, input, matches, NAME_SEARCH_RESULTS);
+        if (count == 0) {
+            printf("No patient name close to '%s'. Please try again.\n", input);
+            continue;
+        }
+        printNameMatches(state, matches, count);
+        if (count == 1) {
+            char confirm[10];
+            int index = findPatientById(state, matches[0].patientId);
+            printf("Use patient '%s' (ID: %d)? (yes/no): ", state->patients[index].name, matches[0].patientId);
+            getStringInput("", confirm, sizeof(confirm));
+            return strcmp(confirm, "yes") == 0 ? index : -1;
+        }
+    }
+}
+
+void searchPatientByName(struct AppState* state) {
+    char name[NAME_LEN];
+    struct NameMatch matches[NAME_SEARCH_RESULTS * 2];
+    getStringInput("Enter Patient Name (typos are OK): ", name, NAME_LEN);
+    double started = currentTimeMillis();
+    int count = searchPatientsByName(state, name, matches, NAME_SEARCH_RESULTS * 2);
+    double elapsed = currentTimeMillis() - started;
+    if (count == 0) {
+        printf("No patient name close to '%s'.\n", name);
+        return;
+    }
+    printNameMatches(state, matches, count);
+    printf("%d match(es) in %.3f ms.\n", count, elapsed);
+}
+
+// --- Dashboard Aggregates ---
+// Counts per doctor per day, bills and revenue per day, and active patients,
+// updated by a constant amount of work on every change so the dashboard never
+// scans appointments[] or bills[]. Appointment and bill dates that do not
+// parse are counted under day -1.
+
+long long toCents(float amount) {
+    return (long long)(amount * 100.0 + (amount >= 0 ? 0.5 : -0.5));
+}
+
+int aggregateSlot(int keyA, int keyB) {
+    unsigned int h = (unsigned int)keyA * 2654435761u ^ (unsigned int)keyB * 40503u;
+    return (int)((h ^ (h >> 15)) % AGGREGATE_SLOTS);
+}
+
+// Row for a key, or NULL if it has never been counted
+struct AggregateEntry* findAggregate(struct AggregateTable* table, int keyA, int keyB) {
+    int slot = aggregateSlot(keyA, keyB);
+    for (int probe = 0; probe < AGGREGATE_SLOTS; probe++) {
+        struct AggregateEntry* e = &table->entries[slot];
+        if (!e->inUse) return NULL;
+        if (e->keyA == keyA && e->keyB == keyB) return e;
+        slot = (slot + 1) % AGGREGATE_SLOTS;
+    }
+    return NULL;
+}
+
+int isEmptyAggregate(struct AggregateEntry* e) {
+    return e->counts[0] == 0 && e->counts[1] == 0 && e->cents == 0;
+}
+
+// Drop rows that are back to zero (keeps probe chains short)
+void compactAggregates(struct AggregateTable* table) {
+    struct AggregateEntry live[AGGREGATE_SLOTS];
+    int liveCount = 0;
+    for (int i = 0; i < AGGREGATE_SLOTS; i++) {
+        if (table->entries[i].inUse && !isEmptyAggregate(&table->entries[i])) {
+            live[liveCount++] = table->entries[i];
+        }
+    }
+    memset(table, 0, sizeof(*table));
+    for (int i = 0; i < liveCount; i++) {
+        int slot = aggregateSlot(live[i].keyA, live[i].keyB);
+        while (table->entries[slot].inUse) slot = (slot + 1) % AGGREGATE_SLOTS;
+        table->entries[slot] = live[i];
+        table->used++;
+    }
+}
+
+// Row for a key, created if needed. Compaction runs only when the table is
+// three quarters full, so the cost stays constant on average.
+struct AggregateEntry* getAggregate(struct AggregateTable* table, int keyA, int keyB) {
+    struct AggregateEntry* e = findAggregate(table, keyA, keyB);
+    if (e != NULL) return e;
+    if (table->used >= AGGREGATE_SLOTS * 3 / 4) {
+        compactAggregates(table);
+        if (table->used >= AGGREGATE_SLOTS - 1) return NULL; // Full: the caller counts it as untracked
+    }
+    int slot = aggregateSlot(keyA, keyB);
+    while (table->entries[slot].inUse) slot = (slot + 1) % AGGREGATE_SLOTS;
+    e = &table->entries[slot];
+    memset(e, 0, sizeof(*e));
+    e->inUse = 1;
+    e->keyA = keyA;
+    e->keyB = keyB;
+    table->used++;
+    return e;
+}
+
+int aggregateCount(struct AggregateTable* table, int keyA, int keyB, int which) {
+    struct AggregateEntry* e = findAggregate(table, keyA, keyB);
+    return e != NULL ? e->counts[which] : 0;
+}
+
+// A patient is active while on file and referenced by an appointment or bill
+// The count* functions return -1 if a full table kept part of the change from
+// being counted (also added to dash->untracked, which the dashboard reports)
+int countPatientActivity(struct Dashboard* dash, int patientId, int refDelta, int fileDelta) {
+    struct AggregateEntry* e = getAggregate(&dash->patient, patientId, 0);
+    if (e == NULL) {
+        dash->untracked++;
+        return -1;
+    }
+    int wasActive = e->counts[0] > 0 && e->counts[1] > 0;
+    e->counts[0] += refDelta;
+    e->counts[1] += fileDelta;
+    int isActive = e->counts[0] > 0 && e->counts[1] > 0;
+    dash->activePatients += isActive - wasActive;
+    dash->patients += fileDelta;
+    return 0;
+}
+
+// delta is +1 when an appointment is added, -1 when it is removed
+int countAppointment(struct Dashboard* dash, struct Appointment* appt, int delta) {
+    int rc = 0;
+    int day = parseDate(appt->date);
+    struct AggregateEntry* e = getAggregate(&dash->doctorDay, appt->doctorId, day);
+    if (e != NULL) e->counts[0] += delta;
+    else rc = -1;
+    e = getAggregate(&dash->day, day, 0);
+    if (e != NULL) e->counts[0] += delta;
+    else rc = -1;
+    dash->appointments += delta;
+    if (rc != 0) dash->untracked++;
+    return countPatientActivity(dash, appt->patientId, delta, 0) | rc;
+}
+
+int countBill(struct Dashboard* dash, struct Bill* b, int delta) {
+    int rc = 0;
+    long long cents = toCents(b->totalAmount) * delta;
+    struct AggregateEntry* e = getAggregate(&dash->day, parseDate(b->dateGenerated), 0);
+    if (e != NULL) {
+        e->counts[1] += delta;
+        e->cents += cents;
+    } else {
+        dash->untracked++;
+        rc = -1;
+    }
+    dash->bills += delta;
+    dash->revenueCents += cents;
+    return countPatientActivity(dash, b->patientId, delta, 0) | rc;
+}
+
+// Full recount, used at load time and by the consistency check
+void computeDashboard(struct AppState* state, struct Dashboard* dash) {
+    memset(dash, 0, sizeof(*dash));
+    for (int i = 0; i < state->patientCount; i++) {
+        countPatientActivity(dash, state->patients[i].id, 0, 1);
+    }
+    for (int i = 0; i < state->appointmentCount; i++) {
+        countAppointment(dash, &state->appointments[i], 1);
+    }
+    for (int i = 0; i < state->billCount; i++) {
+        countBill(dash, &state->bills[i], 1);
+    }
+}
+
+void rebuildDashboard(struct AppState* state) {
+    computeDashboard(state, &state->dashboard);
+}
+
+void printDashboardDay(struct AppState* state, int day) {
+    struct Dashboard* dash = &state->dashboard;
+    char dateText[DATE_LEN];
+    formatDate(day, dateText);
+    struct AggregateEntry* totals = findAggregate(&dash->day, day, 0);
+
+    printf("\n--- Dashboard for %s ---\n", dateText);
+    printf(" Appointments  : %d\n", totals != NULL ? totals->counts[0] : 0);
+    printf(" Bills         : %d\n", totals != NULL ? totals->counts[1] : 0);
+    printf(" Revenue       : %.2f\n", totals != NULL ? totals->cents / 100.0 : 0.0);
+    printf("----------------------------------------------------\n");
+    printf("Doctor ID | Doctor Name          | Appointments\n");
+    printf("----------------------------------------------------\n");
+    for (int i = 0; i < state->doctorCount; i++) {
+        int count = aggregateCount(&dash->doctorDay, state->doctors[i].id, day, 0);
+        if (count == 0) continue;
+        printf("%-9d | %-20s | %d\n", state->doctors[i].id, state->doctors[i].name, count);
+    }
+    printf("----------------------------------------------------\n");
+    printf(" Patients on file : %d (active: %d)\n", dash->patients, dash->activePatients);
+    printf(" All appointments : %d\n", dash->appointments);
+    printf(" All bills        : %d (revenue %.2f)\n", dash->bills, dash->revenueCents / 100.0);
+    printf(" (Working tables only: archived appointments and bills are not counted.)\n");
+    if (dash->untracked > 0) {
+        printf("Warning: %d count update(s) were lost because a dashboard table is full.\n", dash->untracked);
+    }
+}
+
+void viewDashboardToday(struct AppState* state) {
+    printDashboardDay(state, todayDayNumber(NULL));
+}
+
+void viewDashboardForDate(struct AppState* state) {
+    char dateText[DATE_LEN];
+    getStringInput("Enter Date (YYYY-MM-DD): ", dateText, DATE_LEN);
+    int day = parseDate(dateText);
+    if (day == -1) {
+        printf("Invalid date.\n");
+        return;
+    }
+    printDashboardDay(state, day);
+}
+
+int compareAggregateKeys(const void* a, const void* b) {
+    const struct AggregateEntry* x = a;
+    const struct AggregateEntry* y = b;
+    if (x->keyA != y->keyA) return x->keyA < y->keyA ? -1 : 1;
+    if (x->keyB != y->keyB) return x->keyB < y->keyB ? -1 : 1;
+    return 0;
+}
+
+// Non-zero rows of a table, sorted by key. Returns the row count.
+int sortedAggregates(struct AggregateTable* table, struct AggregateEntry* out) {
+    int count = 0;
+    for (int i = 0; i < AGGREGATE_SLOTS; i++) {
+        if (table->entries[i].inUse && !isEmptyAggregate(&table->entries[i])) {
+            out[count++] = table->entries[i];
+        }
+    }
+    qsort(out, count, sizeof(struct AggregateEntry), compareAggregateKeys);
+    return count;
+}
+
+int formatDashboard(struct AppState* state, struct TextBuffer* buf) {
+    struct Dashboard* dash = &state->dashboard;
+    struct AggregateEntry* rows = malloc(sizeof(struct AggregateEntry) * AGGREGATE_SLOTS);
+    char dateText[DATE_LEN];
+    int rc = 0;
+    if (rows == NULL) return -1;
+
+    rc |= appendText(buf, "Dashboard - %s\n", state->branchName);
+    rc |= appendText(buf, "patients|%d\nactive_patients|%d\n", dash->patients, dash->activePatients);
+    rc |= appendText(buf, "appointments|%d\nbills|%d\nrevenue|%.2f\n",
+                      dash->appointments, dash->bills, dash->revenueCents / 100.0);
+
+    rc |= appendText(buf, "\n[day] date|appointments|bills|revenue\n");
+    int count = sortedAggregates(&dash->day, rows);
+    for (int i = 0; i < count; i++) {
+        if (rows[i].keyA == -1) snprintf(dateText, DATE_LEN, "undated");
+        else formatDate(rows[i].keyA, dateText);
+        rc |= appendText(buf, "%s|%d|%d|%.2f\n", dateText, rows[i].counts[0], rows[i].counts[1], rows[i].cents / 100.0);
+    }
+
+    rc |= appendText(buf, "\n[doctor_day] doctor_id|date|appointments\n");
+    count = sortedAggregates(&dash->doctorDay, rows);
+    for (int i = 0; i < count; i++) {
+        if (rows[i].keyB == -1) snprintf(dateText, DATE_LEN, "undated");
+        else formatDate(rows[i].keyB, dateText);
+        rc |= appendText(buf, "%d|%s|%d\n", rows[i].keyA, dateText, rows[i].counts[0]);
+    }
+    free(rows);
+    return rc;
+}
+
+void dumpDashboard(struct AppState* state) {
+    struct TextBuffer buf;
+    char path[PATH_LEN];
+    initTextBuffer(&buf);
+    buildDataPath(state, DASHBOARD_FILE, path);
+    if (formatDashboard(state, &buf) != 0) {
+        printf("Error: Not enough memory for the dashboard dump.\n");
+    } else if (writeTextFile(path, &buf) == 0) {
+        printf("Dashboard written to '%s'.\n", path);
+    }
+    freeTextBuffer(&buf);
+}
+
+// Recount everything from the tables and compare with the live figures
+void verifyDashboard(struct AppState* state) {
+    struct Dashboard* fresh = malloc(sizeof(struct Dashboard));
+    struct TextBuffer live, recount;
+    if (fresh == NULL) {
+        printf("Error: Not enough memory to verify the dashboard.\n");
+        return;
+    }
+    struct Dashboard saved = state->dashboard;
+    computeDashboard(state, fresh);
+    initTextBuffer(&live);
+    initTextBuffer(&recount);
+    formatDashboard(state, &live);
+    state->dashboard = *fresh;
+    formatDashboard(state, &recount);
+    state->dashboard = saved;
+
+    if (live.length == recount.length && memcmp(live.data, recount.data, live.length) == 0) {
+        printf("Dashboard matches a full recount.\n");
+    } else {
+        printf("Warning: Dashboard differs from a full recount; it has been rebuilt.\n");
+        state->dashboard = *fresh;
+    }
+    freeTextBuffer(&live);
+    freeTextBuffer(&recount);
+    free(fresh);
+}
+
+// --- Appointment Date Index ---
+// B+-tree over appointments keyed by (date, time, doctor ID). Leaves are
+// chained in key order, so a date range is read by descending once to its
+// first leaf and following the chain until the range ends. Removals only
+// shrink leaves; the tree is rebuilt packed once removals outnumber the
+// appointments still indexed. Appointments whose date does not parse are not
+// indexed; a time that does not parse sorts first in its day.
+
+int compareDateKeys(const struct DateKey* a, const struct DateKey* b) {
+    if (a->day != b->day) return (a->day > b->day) - (a->day < b->day);
+    if (a->minute != b->minute) return (a->minute > b->minute) - (a->minute < b->minute);
+    if (a->doctorId != b->doctorId) return (a->doctorId > b->doctorId) - (a->doctorId < b->doctorId);
+    return (a->appointmentId > b->appointmentId) - (a->appointmentId < b->appointmentId);
+}
+
+// Returns -1 if the appointment's date does not parse
+int dateKeyOf(struct Appointment* appt, struct DateKey* key) {
+    key->day = parseDate(appt->date);
+    key->minute = parseTime(appt->time); // -1 if unreadable
+    key->doctorId = appt->doctorId;
+    key->appointmentId = appt->id;
+    return key->day < 0 ? -1 : 0;
+}
+
+int allocDateNode(struct DateIndex* index, int leaf) {
+    if (index->nodeCount >= DATE_INDEX_NODES) return -1;
+    int n = index->nodeCount++;
+    index->nodes[n].leaf = leaf;
+    index->nodes[n].count = 0;
+    index->nodes[n].next = -1;
+    return n;
+}
+
+// Child of an inner node whose subtree holds key (and every larger key up to
+// the next separator)
+int dateChildFor(struct DateIndexNode* node, struct DateKey* key) {
+    int low = 0, high = node->count;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (compareDateKeys(&node->keys[mid], key) <= 0) low = mid + 1;
+        else high = mid;
+    }
+    return node->children[low];
+}
+
+int findDateLeaf(struct DateIndex* index, struct DateKey* key) {
+    int n = index->root;
+    while (n != -1 && !index->nodes[n].leaf) {
+        n = dateChildFor(&index->nodes[n], key);
+    }
+    return n;
+}
+
+int compareDateEntries(const void* a, const void* b) {
+    return compareDateKeys(&((const struct DateEntry*)a)->key, &((const struct DateEntry*)b)->key);
+}
+
+// Bulk-load the tree from appointments[], leaving room in every node
+void rebuildDateIndex(struct AppState* state) {
+    struct DateIndex* index = &state->dateIndex;
+    struct DateEntry entries[MAX_APPOINTMENTS];
+    int level[DATE_INDEX_NODES];
+    struct DateKey low[DATE_INDEX_NODES]; // Smallest key under level[i]
+    int count = 0;
+
+    for (int i = 0; i < state->appointmentCount; i++) {
+        if (dateKeyOf(&state->appointments[i], &entries[count].key) == 0) {
+            entries[count].patientId = state->appointments[i].patientId;
+            count++;
+        }
+    }
+    qsort(entries, count, sizeof(struct DateEntry), compareDateEntries);
+
+    index->nodeCount = 0;
+    index->root = -1;
+    index->entryCount = count;
+    index->removedCount = 0;
+
+    int levelCount = 0;
+    int previous = -1;
+    for (int i = 0; i < count; i += DATE_INDEX_FILL) {
+        int n = allocDateNode(index, 1);
+        struct DateIndexNode* leaf = &index->nodes[n];
+        for (int j = i; j < count && j < i + DATE_INDEX_FILL; j++) {
+            leaf->keys[leaf->count] = entries[j].key;
+            leaf->patientIds[leaf->count] = entries[j].patientId;
+            leaf->count++;
+        }
+        if (previous != -1) index->nodes[previous].next = n;
+        previous = n;
+        level[levelCount] = n;
+        low[levelCount] = entries[i].key;
+        levelCount++;
+    }
+    // Inner levels, bottom up, until a single node is left
+    while (levelCount > 1) {
+        int upper = 0;
+        for (int i = 0; i < levelCount; i += DATE_INDEX_FILL + 1) {
+            int n = allocDateNode(index, 0);
+            struct DateIndexNode* inner = &index->nodes[n];
+            for (int j = i; j < levelCount && j < i + DATE_INDEX_FILL + 1; j++) {
+                if (j > i) inner->keys[inner->count++] = low[j];
+                inner->children[j - i] = level[j];
+            }
+            level[upper] = n;
+            low[upper] = low[i];
+            upper++;
+        }
+        levelCount = upper;
+    }
+    if (levelCount == 1) index->root = level[0];
+}
+
+// Insert into the subtree at node. If the node splits, returns its new right
+// sibling and sets *separator to the smallest key under it; otherwise -1.
+// The caller makes sure enough free nodes remain.
+int insertDateEntry(struct DateIndex* index, int node, struct DateKey* key, int patientId,
+                    struct DateKey* separator) {
+    struct DateIndexNode* n = &index->nodes[node];
+    struct DateKey keys[DATE_INDEX_FANOUT + 1];
+    int values[DATE_INDEX_FANOUT + 2];
+    int pos = 0;
+
+    if (n->leaf) {
+        while (pos < n->count && compareDateKeys(&n->keys[pos], key) < 0) pos++;
+        if (n->count < DATE_INDEX_FANOUT) {
+            memmove(&n->keys[pos + 1], &n->keys[pos], (n->count - pos) * sizeof(struct DateKey));
+            memmove(&n->patientIds[pos + 1], &n->patientIds[pos], (n->count - pos) * sizeof(int));
+            n->keys[pos] = *key;
+            n->patientIds[pos] = patientId;
+            n->count++;
+            return -1;
+        }
+        // Full: split the entries plus the new one between this leaf and a new one
+        for (int i = 0, j = 0; i <= n->count; i++) {
+            if (i == pos) {
+                keys[i] = *key;
+                values[i] = patientId;
+            } else {
+                keys[i] = n->keys[j];
+                values[i] = n->patientIds[j];
+                j++;
+            }
+        }
+        int total = n->count + 1;
+        int half = total / 2;
+        int r = allocDateNode(index, 1);
+        struct DateIndexNode* right = &index->nodes[r];
+        n->count = half;
+        memcpy(n->keys, keys, half * sizeof(struct DateKey));
+        memcpy(n->patientIds, values, half * sizeof(int));
+        right->count = total - half;
+        memcpy(right->keys, &keys[half], right->count * sizeof(struct DateKey));
+        memcpy(right->patientIds, &values[half], right->count * sizeof(int));
+        right->next = n->next;
+        n->next = r;
+        *separator = right->keys[0];
+        return r;
+    }
+
+    while (pos < n->count && compareDateKeys(&n->keys[pos], key) <= 0) pos++;
+    struct DateKey childSeparator;
+    int split = insertDateEntry(index, n->children[pos], key, patientId, &childSeparator);
+    if (split == -1) return -1;
+
+    if (n->count < DATE_INDEX_FANOUT) {
+        memmove(&n->keys[pos + 1], &n->keys[pos], (n->count - pos) * sizeof(struct DateKey));
+        memmove(&n->children[pos + 2], &n->children[pos + 1], (n->count - pos) * sizeof(int));
+        n->keys[pos] = childSeparator;
+        n->children[pos + 1] = split;
+        n->count++;
+        return -1;
+    }
+    // Full inner node: the middle key moves up, the rest is shared out
+    for (int i = 0, j = 0; i <= n->count; i++) {
+        keys[i] = (i == pos) ? childSeparator : n->keys[j++];
+    }
+    values[0] = n->children[0];
+    for (int i = 1, j = 1; i <= n->count + 1; i++) {
+        values[i] = (i == pos + 1) ? split : n->children[j++];
+    }
+    int total = n->count + 1;
+    int middle = total / 2;
+    int r = allocDateNode(index, 0);
+    struct DateIndexNode* right = &index->nodes[r];
+    n->count = middle;
+    memcpy(n->keys, keys, middle * sizeof(struct DateKey));
+    memcpy(n->children, values, (middle + 1) * sizeof(int));
+    right->count = total - middle - 1;
+    memcpy(right->keys, &keys[middle + 1], right->count * sizeof(struct DateKey));
+    memcpy(right->children, &values[middle + 1], (right->count + 1) * sizeof(int));
+    *separator = keys[middle];
+    return r;
+}
+
+// Removed entries leave leaves under-full; repack once they outnumber the rest
+int dateIndexNeedsRebuild(struct DateIndex* index) {
+    return index->removedCount > index->entryCount && index->removedCount >= DATE_INDEX_FANOUT;
+}
+
+// Call after the appointment is stored in appointments[]
+void indexAppointmentDate(struct AppState* state, struct Appointment* appt) {
+    struct DateIndex* index = &state->dateIndex;
+    struct DateKey key;
+    if (dateKeyOf(appt, &key) != 0) return;
+
+    // A split can add one node per level plus a new root
+    int height = 0;
+    for (int n = index->root; n != -1; n = index->nodes[n].leaf ? -1 : index->nodes[n].children[0]) {
+        height++;
+    }
+    if (index->nodeCount + height + 1 > DATE_INDEX_NODES || dateIndexNeedsRebuild(index)) {
+        rebuildDateIndex(state); // Packs the tree (includes appt)
+        return;
+    }
+    if (index->root == -1) index->root = allocDateNode(index, 1);
+
+    struct DateKey separator;
+    int split = insertDateEntry(index, index->root, &key, appt->patientId, &separator);
+    if (split != -1) {
+        int root = allocDateNode(index, 0);
+        index->nodes[root].count = 1;
+        index->nodes[root].keys[0] = separator;
+        index->nodes[root].children[0] = index->root;
+        index->nodes[root].children[1] = split;
+        index->root = root;
+    }
+    index->entryCount++;
+}
+
+// Call after the appointment is gone from appointments[] (or replaced). Only
+// shrinks the leaf; insertions and removeAppointmentAt rebuild when needed.
+void unindexAppointmentDate(struct AppState* state, struct Appointment* appt) {
+    struct DateIndex* index = &state->dateIndex;
+    struct DateKey key;
+    if (dateKeyOf(appt, &key) != 0) return;
+
+    int n = findDateLeaf(index, &key);
+    if (n == -1) return;
+    struct DateIndexNode* leaf = &index->nodes[n];
+    for (int i = 0; i < leaf->count; i++) {
+        if (compareDateKeys(&leaf->keys[i], &key) == 0) {
+            memmove(&leaf->keys[i], &leaf->keys[i + 1], (leaf->count - i - 1) * sizeof(struct DateKey));
+            memmove(&leaf->patientIds[i], &leaf->patientIds[i + 1], (leaf->count - i - 1) * sizeof(int));
+            leaf->count--;
+            index->entryCount--;
+            index->removedCount++;
+            break;
+        }
+    }
+}
+
+
+// Up to max appointments after *cursor, in date order, up to and including
+// lastDay. doctorId 0 means all doctors. Pass the last key returned as the
+// next cursor to continue; the page stays correct when appointments are added
+// or cancelled in between.
+int scanDateIndex(struct DateIndex* index, struct DateKey* cursor, int lastDay, int doctorId,
+                  struct DateEntry* out, int max) {
+    int count = 0;
+    int n = findDateLeaf(index, cursor);
+    int pos = 0;
+    if (n != -1) {
+        while (pos < index->nodes[n].count && compareDateKeys(&index->nodes[n].keys[pos], cursor) <= 0) pos++;
+    }
+    while (n != -1 && count < max) {
+        struct DateIndexNode* leaf = &index->nodes[n];
+        for (; pos < leaf->count && count < max; pos++) {
+            if (leaf->keys[pos].day > lastDay) return count;
+            if (doctorId != 0 && leaf->keys[pos].doctorId != doctorId) continue;
+            out[count].key = leaf->keys[pos];
+            out[count].patientId = leaf->patientIds[pos];
+            count++;
+        }
+        if (pos < leaf->count) break;
+        n = leaf->next;
+        pos = 0;
+    }
+    return count;
+}
+
+// --- Snapshots (Multi-Version Reads) ---
+// Patients, appointments and bills are also kept as versions stamped with
+// commit sequences. A version is visible to a snapshot at sequence s when
+// begin <= s < end. Writers (the record mutation helpers) add versions under
+// the next sequence and publish it on commit, so a snapshot sees a whole
+// transaction or none of it. Readers take no locks: they register their
+// sequence, scan the version chunks, and discard any slot that was recycled
+// while they copied it. Versions no open snapshot can see are collected
+// every few commits. Writes still come from one thread at a time (the menus);
+// there is no rollback, so operations validate before they write.
+
+struct VersionStore* versionStoreFor(struct AppState* state, int table) {
+    switch (table) {
+        case TABLE_PATIENT: return &state->patientVersions;
+        case TABLE_APPOINTMENT: return &state->appointmentVersions;
+        case TABLE_BILL: return &state->billVersions;
+        default: return NULL;
+    }
+}
+
+struct RecordVersion* versionAt(struct VersionStore* store, int slot) {
+    return &store->chunks[slot / MVCC_CHUNK_VERSIONS][slot % MVCC_CHUNK_VERSIONS];
+}
+
+void freeVersionStores(struct AppState* state) {
+    struct VersionStore* stores[] = {&state->patientVersions, &state->appointmentVersions, &state->billVersions};
+    for (int s = 0; s < 3; s++) {
+        for (int c = 0; c < stores[s]->chunkCount; c++) free(stores[s]->chunks[c]);
+        memset(stores[s], 0, sizeof(struct VersionStore));
+        stores[s]->freeHead = -1;
+    }
+}
+
+// A free version slot, adding a chunk when all are in use. Returns -1 if the
+// store is at MVCC_MAX_CHUNKS.
+int allocVersion(struct VersionStore* store) {
+    if (store->freeHead == -1) {
+        if (store->chunkCount >= MVCC_MAX_CHUNKS) return -1;
+        struct RecordVersion* chunk = malloc(MVCC_CHUNK_VERSIONS * sizeof(struct RecordVersion));
+        if (chunk == NULL) return -1;
+        int first = store->chunkCount * MVCC_CHUNK_VERSIONS;
+        for (int i = 0; i < MVCC_CHUNK_VERSIONS; i++) {
+            chunk[i].begin = MVCC_NEVER;
+            chunk[i].end = MVCC_NEVER;
+            chunk[i].nextFree = (i + 1 < MVCC_CHUNK_VERSIONS) ? first + i + 1 : -1;
+        }
+        store->chunks[store->chunkCount] = chunk;
+        __atomic_store_n(&store->chunkCount, store->chunkCount + 1, __ATOMIC_RELEASE);
+        store->freeHead = first;
+    }
+    int slot = store->freeHead;
+    store->freeHead = versionAt(store, slot)->nextFree;
+    store->used++;
+    return slot;
+}
+
+// Linear-probing hash of each record's newest version (backward-shift
+// deletion, no tombstones). Records without a version have no entry.
+int versionHeadOf(int id) {
+    return (int)(((unsigned int)id * 2654435761u) % MVCC_HEAD_SLOTS);
+}
+
+struct VersionHead* findVersionHead(struct VersionStore* store, int id) {
+    int slot = versionHeadOf(id);
+    while (store->heads[slot].id != 0) {
+        if (store->heads[slot].id == id) return &store->heads[slot];
+        slot = (slot + 1) % MVCC_HEAD_SLOTS;
+    }
+    return NULL;
+}
+
+void setVersionHead(struct VersionStore* store, int id, int versionSlot) {
+    struct VersionHead* head = findVersionHead(store, id);
+    if (head == NULL) {
+        int slot = versionHeadOf(id);
+        while (store->heads[slot].id != 0) slot = (slot + 1) % MVCC_HEAD_SLOTS;
+        head = &store->heads[slot];
+        head->id = id;
+    }
+    head->slot = versionSlot;
+}
+
+void removeVersionHead(struct VersionStore* store, int id) {
+    struct VersionHead* found = findVersionHead(store, id);
+    if (found == NULL) return;
+    int hole = (int)(found - store->heads);
+    int slot = hole;
+    found->id = 0;
+    // Pull later entries of the probe run back into the hole
+    while (1) {
+        slot = (slot + 1) % MVCC_HEAD_SLOTS;
+        if (store->heads[slot].id == 0) return;
+        int home = versionHeadOf(store->heads[slot].id);
+        int reachable = (hole <= slot) ? (home <= hole || home > slot) : (home <= hole && home > slot);
+        if (reachable) {
+            store->heads[hole] = store->heads[slot];
+            store->heads[slot].id = 0;
+            hole = slot;
+        }
+    }
+}
+
+// Newest committed or pending version of a record, or NULL if it has none
+struct RecordVersion* currentVersion(struct VersionStore* store, int id) {
+    struct VersionHead* head = findVersionHead(store, id);
+    return head != NULL ? versionAt(store, head->slot) : NULL;
+}
+
+// Reclaim versions that ended at or before 'horizon'
+void reclaimVersions(struct AppState* state, long long horizon) {
+    struct VersionStore* stores[] = {&state->patientVersions, &state->appointmentVersions, &state->billVersions};
+    for (int s = 0; s < 3; s++) {
+        struct VersionStore* store = stores[s];
+        for (int slot = 0; slot < store->chunkCount * MVCC_CHUNK_VERSIONS; slot++) {
+            struct RecordVersion* v = versionAt(store, slot);
+            if (v->begin == MVCC_NEVER || v->end > horizon) continue;
+            __atomic_store_n(&v->begin, MVCC_NEVER, __ATOMIC_RELEASE); // Readers copying it will notice
+            v->nextFree = store->freeHead;
+            store->freeHead = slot;
+            store->used--;
+        }
+    }
+}
+
+// Oldest sequence any open snapshot (or a snapshot opened now) can read
+long long oldestVisibleSequence(struct AppState* state) {
+    long long oldest = __atomic_load_n(&state->commitSequence, __ATOMIC_SEQ_CST);
+    for (int i = 0; i < MVCC_MAX_SNAPSHOTS; i++) {
+        long long sequence = __atomic_load_n(&state->snapshots[i], __ATOMIC_SEQ_CST);
+        if (sequence != 0 && sequence < oldest) oldest = sequence;
+    }
+    return oldest;
+}
+
+void collectVersions(struct AppState* state) {
+    reclaimVersions(state, oldestVisibleSequence(state));
+    state->commitsSinceCollect = 0;
+}
+
+void beginTransaction(struct AppState* state) {
+    if (state->transactionDepth++ == 0) {
+        state->pendingSequence = state->commitSequence + 1;
+    }
+}
+
+// Publish the transaction's versions to snapshots opened from now on
+void commitTransaction(struct AppState* state) {
+    if (--state->transactionDepth > 0) return;
+    __atomic_store_n(&state->commitSequence, state->pendingSequence, __ATOMIC_SEQ_CST);
+    if (++state->commitsSinceCollect >= MVCC_GC_EVERY) collectVersions(state);
+}
+
+// Record the new image of a record (data NULL: the record was deleted).
+// Called by the record mutation helpers.
+void writeVersion(struct AppState* state, int table, int id, void* data, size_t dataSize) {
+    struct VersionStore* store = versionStoreFor(state, table);
+    if (store == NULL) return;
+    beginTransaction(state);
+    long long sequence = state->pendingSequence;
+    struct RecordVersion* old = currentVersion(store, id);
+    int slot = -1;
+
+    if (data != NULL) {
+        slot = allocVersion(store);
+        if (slot == -1) {
+            collectVersions(state);
+            slot = allocVersion(store);
+        }
+        if (slot == -1) {
+            // Snapshots have pinned every version: drop the old ones anyway,
+            // and let the reports that were reading them say so
+            printf("Warning: Version store is full; reports in progress may be inconsistent.\n");
+            reclaimVersions(state, state->commitSequence);
+            __atomic_add_fetch(&state->forcedCollections, 1, __ATOMIC_SEQ_CST);
+            slot = allocVersion(store);
+        }
+        if (slot != -1) {
+            struct RecordVersion* v = versionAt(store, slot);
+            v->end = MVCC_NEVER;
+            v->id = id;
+            memcpy(&v->data, data, dataSize);
+            __atomic_store_n(&v->begin, sequence, __ATOMIC_RELEASE);
+        }
+    }
+    if (old != NULL) __atomic_store_n(&old->end, sequence, __ATOMIC_RELEASE);
+    if (slot != -1) setVersionHead(store, id, slot);
+    else removeVersionHead(store, id);
+    commitTransaction(state);
+}
+
+// Start the version stores over from the current tables (after a load)
+void resetVersionStores(struct AppState* state) {
+    freeVersionStores(state);
+    state->commitSequence = 0;
+    state->transactionDepth = 0;
+    beginTransaction(state);
+    for (int i = 0; i < state->patientCount; i++) {
+        writeVersion(state, TABLE_PATIENT, state->patients[i].id, &state->patients[i], sizeof(struct Patient));
+    }
+    for (int i = 0; i < state->appointmentCount; i++) {
+        writeVersion(state, TABLE_APPOINTMENT, state->appointments[i].id, &state->appointments[i],
+                     sizeof(struct Appointment));
+    }
+    for (int i = 0; i < state->billCount; i++) {
+        writeVersion(state, TABLE_BILL, state->bills[i].id, &state->bills[i], sizeof(struct Bill));
+    }
+    commitTransaction(state);
+}
+
+// Returns -1 if MVCC_MAX_SNAPSHOTS snapshots are already open
+int openSnapshot(struct AppState* state, struct Snapshot* snap) {
+    for (int i = 0; i < MVCC_MAX_SNAPSHOTS; i++) {
+        long long expected = 0;
+        long long sequence = __atomic_load_n(&state->commitSequence, __ATOMIC_SEQ_CST);
+        if (!__atomic_compare_exchange_n(&state->snapshots[i], &expected, sequence, 0,
+                                         __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+            continue;
+        }
+        // A commit in between may have been collected without seeing this
+        // slot; move up to the newer sequence until none slips through
+        long long latest;
+        while ((latest = __atomic_load_n(&state->commitSequence, __ATOMIC_SEQ_CST)) != sequence) {
+            sequence = latest;
+            __atomic_store_n(&state->snapshots[i], sequence, __ATOMIC_SEQ_CST);
+        }
+        snap->state = state;
+        snap->sequence = sequence;
+        snap->slot = i;
+        snap->forcedCollections = __atomic_load_n(&state->forcedCollections, __ATOMIC_SEQ_CST);
+        return 0;
+    }
+    return -1;
+}
+
+void closeSnapshot(struct Snapshot* snap) {
+    struct AppState* state = snap->state;
+    if (__atomic_load_n(&state->forcedCollections, __ATOMIC_SEQ_CST) != snap->forcedCollections) {
+        printf("Warning: Records changed faster than old versions could be kept; this report may be inconsistent.\n");
+    }
+    __atomic_store_n(&state->snapshots[snap->slot], 0, __ATOMIC_SEQ_CST);
+}
+
+int compareLeadingIds(const void* a, const void* b) {
+    int idA = *(const int*)a; // Patient, Appointment and Bill all start with their ID
+    int idB = *(const int*)b;
+    return (idA > idB) - (idA < idB);
+}
+
+// Copy the table's records as of the snapshot into out (up to max), in ID order
+int readSnapshot(struct Snapshot* snap, int table, void* out, size_t recordSize, int max) {
+    struct VersionStore* store = versionStoreFor(snap->state, table);
+    char* rows = (char*)out;
+    int count = 0;
+    int chunkCount = __atomic_load_n(&store->chunkCount, __ATOMIC_ACQUIRE);
+    for (int c = 0; c < chunkCount && count < max; c++) {
+        struct RecordVersion* chunk = __atomic_load_n(&store->chunks[c], __ATOMIC_ACQUIRE);
+        for (int i = 0; i < MVCC_CHUNK_VERSIONS && count < max; i++) {
+            struct RecordVersion* v = &chunk[i];
+            long long begin = __atomic_load_n(&v->begin, __ATOMIC_ACQUIRE);
+            if (begin > snap->sequence) continue;
+            if (__atomic_load_n(&v->end, __ATOMIC_ACQUIRE) <= snap->sequence) continue;
+            memcpy(rows + count * recordSize, &v->data, recordSize);
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&v->begin, __ATOMIC_ACQUIRE) != begin) continue; // Recycled meanwhile
+            count++;
+        }
+    }
+    qsort(rows, count, recordSize, compareLeadingIds);
+    return count;
+}
+
+// Name of a patient in a snapshot's patient list (sorted by ID)
+char* snapshotPatientName(struct Patient* patients, int count, int id) {
+    struct Patient* p = bsearch(&id, patients, count, sizeof(struct Patient), compareLeadingIds);
+    return p != NULL ? p->name : "Unknown Patient";
+}
+
+// Patients, appointments and bills as of one commit, copied for a report
+struct TableSnapshot {
+    struct Patient patients[MAX_PATIENTS];
+    int patientCount;
+    struct Appointment appointments[MAX_APPOINTMENTS];
+    int appointmentCount;
+    struct Bill bills[MAX_BILLS];
+    int billCount;
+};
+
+// Returns NULL (after saying why) if no snapshot could be taken; free() the result
+struct TableSnapshot* takeTableSnapshot(struct AppState* state) {
+    struct Snapshot snap;
+    struct TableSnapshot* tables = malloc(sizeof(struct TableSnapshot));
+    if (tables == NULL) {
+        printf("Error: Not enough memory for the report.\n");
+        return NULL;
+    }
+    if (openSnapshot(state, &snap) != 0) {
+        printf("Error: Too many reports are running; try again shortly.\n");
+        free(tables);
+        return NULL;
+    }
+    tables->patientCount = readSnapshot(&snap, TABLE_PATIENT, tables->patients, sizeof(struct Patient), MAX_PATIENTS);
+    tables->appointmentCount = readSnapshot(&snap, TABLE_APPOINTMENT, tables->appointments,
+                                            sizeof(struct Appointment), MAX_APPOINTMENTS);
+    tables->billCount = readSnapshot(&snap, TABLE_BILL, tables->bills, sizeof(struct Bill), MAX_BILLS);
+    closeSnapshot(&snap);
+    return tables;
+}
+
+// --- Record Mutations ---
+// All table changes go through these helpers so the slot calendar, the
+// change log and the snapshot versions stay in step. Replicas apply shipped
+// changes through them too.
+
+void insertPatientRecord(struct AppState* state, struct Patient* p) {
+    state->patients[state->patientCount++] = *p;
+    recordPatientVersion(state, p->id, NULL, p);
+    indexPatientName(state, p);
+    countPatientActivity(&state->dashboard, p->id, 0, 1);
+    logChange(state, TABLE_PATIENT, OP_UPSERT, p->id, p, sizeof(struct Patient));
+    publishChange(state, TABLE_PATIENT, CDC_INSERT, p->id, p, sizeof(struct Patient));
+    writeVersion(state, TABLE_PATIENT, p->id, p, sizeof(struct Patient));
+}
+
+void updatePatientRecord(struct AppState* state, int index, struct Patient* p) {
+    recordPatientVersion(state, p->id, &state->patients[index], p);
+    int renamed = strcmp(state->patients[index].name, p->name) != 0;
+    state->patients[index] = *p;
+    if (renamed) {
+        unindexPatientName(state, p->id);
+        indexPatientName(state, p);
+    }
+    logChange(state, TABLE_PATIENT, OP_UPSERT, p->id, p, sizeof(struct Patient));
+    publishChange(state, TABLE_PATIENT, CDC_UPDATE, p->id, p, sizeof(struct Patient));
+    writeVersion(state, TABLE_PATIENT, p->id, p, sizeof(struct Patient));
+}
+
+void removePatientAt(struct AppState* state, int index) {
+    int id = state->patients[index].id;
+    recordPatientVersion(state, id, &state->patients[index], NULL);
+    // Shift elements to fill the gap
+    for (int i = index; i < state->patientCount - 1; i++) {
+        state->patients[i] = state->patients[i + 1];
+    }
+    state->patientCount--;
+    unindexPatientName(state, id);
+    removeFromWaitingRoom(state, id);
+    countPatientActivity(&state->dashboard, id, 0, -1);
+    logChange(state, TABLE_PATIENT, OP_DELETE, id, NULL, 0);
+    publishChange(state, TABLE_PATIENT, CDC_DELETE, id, NULL, 0);
+    writeVersion(state, TABLE_PATIENT, id, NULL, 0);
+}
+
+void insertDoctorRecord(struct AppState* state, struct Doctor* d, struct DoctorHours* hours) {
+    struct DoctorHours none = {0, 0, 0, 0};
+    int index = state->doctorCount++;
+    state->doctors[index] = *d;
+    memset(state->bookedSlots[index], 0, sizeof(state->bookedSlots[0]));
+    logChange(state, TABLE_DOCTOR, OP_UPSERT, d->id, d, sizeof(struct Doctor));
+    publishChange(state, TABLE_DOCTOR, CDC_INSERT, d->id, d, sizeof(struct Doctor));
+    updateDoctorHours(state, index, hours != NULL ? hours : &none);
+}
+
+void updateDoctorHours(struct AppState* state, int index, struct DoctorHours* hours) {
+    setDoctorHours(state, index, hours);
+    logChange(state, TABLE_HOURS, OP_UPSERT, state->doctors[index].id,
+              &state->doctorHours[index], sizeof(struct DoctorHours));
+}
+
+void insertAppointmentRecord(struct AppState* state, struct Appointment* appt) {
+    state->appointments[state->appointmentCount++] = *appt;
+    markAppointmentSlot(state, appt);
+    indexAppointmentDate(state, appt);
+    countAppointment(&state->dashboard, appt, 1);
+    logChange(state, TABLE_APPOINTMENT, OP_UPSERT, appt->id, appt, sizeof(struct Appointment));
+    publishChange(state, TABLE_APPOINTMENT, CDC_INSERT, appt->id, appt, sizeof(struct Appointment));
+    writeVersion(state, TABLE_APPOINTMENT, appt->id, appt, sizeof(struct Appointment));
+}
+
+void updateAppointmentRecord(struct AppState* state, int index, struct Appointment* appt) {
+    struct Appointment old = state->appointments[index];
+    state->appointments[index] = *appt;
+    unmarkAppointmentSlot(state, &old);
+    markAppointmentSlot(state, appt);
+    unindexAppointmentDate(state, &old);
+    indexAppointmentDate(state, appt);
+    countAppointment(&state->dashboard, &old, -1);
+    countAppointment(&state->dashboard, appt, 1);
+    logChange(state, TABLE_APPOINTMENT, OP_UPSERT, appt->id, appt, sizeof(struct Appointment));
+    publishChange(state, TABLE_APPOINTMENT, CDC_UPDATE, appt->id, appt, sizeof(struct Appointment));
+    writeVersion(state, TABLE_APPOINTMENT, appt->id, appt, sizeof(struct Appointment));
+}
+
+// cdcOp tells change stream consumers why the record left: CDC_DELETE, or
+// CDC_ARCHIVE when it moved to the archive (the record is sent along then)
+void removeAppointmentAs(struct AppState* state, int index, int cdcOp) {
+    struct Appointment removed = state->appointments[index];
+    // Shift elements to fill the gap
+    for (int i = index; i < state->appointmentCount - 1; i++) {
+        state->appointments[i] = state->appointments[i + 1];
+    }
+    state->appointmentCount--;
+    unmarkAppointmentSlot(state, &removed);
+    unindexAppointmentDate(state, &removed);
+    if (dateIndexNeedsRebuild(&state->dateIndex)) rebuildDateIndex(state);
+    countAppointment(&state->dashboard, &removed, -1);
+    logChange(state, TABLE_APPOINTMENT, OP_DELETE, removed.id, NULL, 0);
+    publishChange(state, TABLE_APPOINTMENT, cdcOp, removed.id,
+                  cdcOp == CDC_ARCHIVE ? &removed : NULL, sizeof(struct Appointment));
+    writeVersion(state, TABLE_APPOINTMENT, removed.id, NULL, 0);
+}
+
+void removeAppointmentAt(struct AppState* state, int index) {
+    removeAppointmentAs(state, index, CDC_DELETE);
+}
+
+void insertBillRecord(struct AppState* state, struct Bill* b) {
+    state->bills[state->billCount++] = *b;
+    countBill(&state->dashboard, b, 1);
+    logChange(state, TABLE_BILL, OP_UPSERT, b->id, b, sizeof(struct Bill));
+    publishChange(state, TABLE_BILL, CDC_INSERT, b->id, b, sizeof(struct Bill));
+    writeVersion(state, TABLE_BILL, b->id, b, sizeof(struct Bill));
+}
+
+void updateBillRecord(struct AppState* state, int index, struct Bill* b) {
+    countBill(&state->dashboard, &state->bills[index], -1);
+    countBill(&state->dashboard, b, 1);
+    state->bills[index] = *b;
+    logChange(state, TABLE_BILL, OP_UPSERT, b->id, b, sizeof(struct Bill));
+    publishChange(state, TABLE_BILL, CDC_UPDATE, b->id, b, sizeof(struct Bill));
+    writeVersion(state, TABLE_BILL, b->id, b, sizeof(struct Bill));
+}
+
+void removeBillAs(struct AppState* state, int index, int cdcOp) {
+    struct Bill removed = state->bills[index];
+    int id = removed.id;
+    countBill(&state->dashboard, &state->bills[index], -1);
+    for (int i = index; i < state->billCount - 1; i++) {
+        state->bills[i] = state->bills[i + 1];
+    }
+    state->billCount--;
+    logChange(state, TABLE_BILL, OP_DELETE, id, NULL, 0);
+    publishChange(state, TABLE_BILL, cdcOp, id, cdcOp == CDC_ARCHIVE ? &removed : NULL, sizeof(struct Bill));
+    writeVersion(state, TABLE_BILL, id, NULL, 0);
+}
+
+void removeBillAt(struct AppState* state, int index) {
+    removeBillAs(state, index, CDC_DELETE);
+}
+
+// --- Appointment Management Functions (Operate on AppState) ---
+
+int findAppointmentById(struct AppState* state, int id) {
+    for (int i = 0; i < state->appointmentCount; i++) {
+        if (state->appointments[i].id == id) {
+            return i; // Return index
+        }
+    }
+    return -1; // Not found
+}
+
+// Ask for the patient, doctor, date and time of a new appointment.
+// Returns the patient's index and sets *doctorIndex, or -1 if no patient was chosen.
+int promptAppointmentDetails(struct AppState* state, struct Appointment* appt, int* doctorIndex) {
+    // Get and validate Patient (by ID, or by name with typo-tolerant search)
+    int patientIndex = promptForPatient(state, "Enter Patient ID or Name: ");
+    if (patientIndex == -1) return -1;
+    appt->patientId = state->patients[patientIndex].id;
+
+    // Get and validate Doctor ID
+    viewDoctors(state); // Show available doctors
+     while (1) {
+        int doctorId = getIntInput("Enter Doctor ID: ");
+        *doctorIndex = findDoctorById(state, doctorId);
+        if (*doctorIndex != -1) {
+            appt->doctorId = doctorId;
+            break;
+        } else {
+            printf("Invalid Doctor ID. Please try again.\n");
+        }
+    }
+
+    // Get Date and Time
+    getStringInput("Enter Appointment Date (YYYY-MM-DD): ", appt->date, DATE_LEN);
+    getStringInput("Enter Appointment Time (HH:MM): ", appt->time, TIME_LEN);
+    return patientIndex;
+}
+
+void scheduleAppointment(struct AppState* state) {
+    if (state->appointmentCount >= MAX_APPOINTMENTS) {
+        printf("Maximum appointment limit reached.\n");
+        return;
+    }
+    if (branchIdsUsedUp(state, state->nextAppointmentId, "appointment")) return;
+    if (state->patientCount == 0) {
+        printf("No patients in the system. Please add a patient first.\n");
+        return;
+    }
+     if (state->doctorCount == 0) {
+        printf("No doctors in the system. Please add a doctor first.\n");
+        return;
+    }
+
+    struct Appointment appt; // Use 'struct Appointment'
+    int patientIndex, doctorIndex;
+
+    printf("--- Schedule New Appointment ---\n");
+    patientIndex = promptAppointmentDetails(state, &appt, &doctorIndex);
+    if (patientIndex == -1) {
+        printf("No patient chosen; appointment not scheduled.\n");
+        return;
+    }
+    appt.id = state->nextAppointmentId++;
+
+    insertAppointmentRecord(state, &appt);
+    printf("Appointment scheduled successfully for Patient %s with Dr. %s on %s at %s (Appt ID: %d)\n",
+           state->patients[patientIndex].name, state->doctors[doctorIndex].name, appt.date, appt.time, appt.id);
+}
+
+// Book an appointment and bill its consultation fee in one transaction, so
+// no report ever shows one without the other
+void scheduleAppointmentWithBill(struct AppState* state) {
+    if (state->appointmentCount >= MAX_APPOINTMENTS || state->billCount >= MAX_BILLS) {
+        printf("Maximum appointment or bill limit reached.\n");
+        return;
+    }
+    if (branchIdsUsedUp(state, state->nextAppointmentId, "appointment")
+        || branchIdsUsedUp(state, state->nextBillId, "bill")) {
+        return;
+    }
+    if (state->patientCount == 0) {
+        printf("No patients in the system. Please add a patient first.\n");
+        return;
+    }
+    if (state->doctorCount == 0) {
+        printf("No doctors in the system. Please add a doctor first.\n");
+        return;
+    }
+
+    struct Appointment appt;
+    struct Bill b;
+    int doctorIndex;
+    printf("--- Schedule Appointment with Bill ---\n");
+    int patientIndex = promptAppointmentDetails(state, &appt, &doctorIndex);
+    if (patientIndex == -1) {
+        printf("No patient chosen; nothing scheduled.\n");
+        return;
+    }
+    b.doctorFee = getFloatInput("Enter Doctor Consultation Fee: ");
+    getStringInput("Enter Bill Date (YYYY-MM-DD): ", b.dateGenerated, DATE_LEN);
+
+    appt.id = state->nextAppointmentId++;
+    b.id = state->nextBillId++;
+    b.patientId = appt.patientId;
+    b.doctorId = appt.doctorId;
+    b.totalAmount = b.doctorFee;
+
+    beginTransaction(state);
+    insertAppointmentRecord(state, &appt);
+    insertBillRecord(state, &b);
+    commitTransaction(state);
+    printf("Appointment scheduled for Patient %s with Dr. %s on %s at %s (Appt ID: %d)\n",
+           state->patients[patientIndex].name, state->doctors[doctorIndex].name, appt.date, appt.time, appt.id);
+    printf("Bill generated (Bill ID: %d), Total Amount: %.2f\n", b.id, b.totalAmount);
+}
+
+void viewAppointments(struct AppState* state) {
+    // Read from a snapshot so changes made meanwhile never show up half-done
+    struct TableSnapshot* tables = takeTableSnapshot(state);
+    if (tables == NULL) return;
+    printf("\n--- Scheduled Appointments (%d) ---\n", tables->appointmentCount);
+    if (tables->appointmentCount == 0) {
+        printf("No appointments scheduled.\n");
+        free(tables);
+        return;
+    }
+    printf("-------------------------------------------------------------------------------------------\n");
+    printf("Appt ID | Patient ID | Patient Name       | Doctor ID | Doctor Name        | Date       | Time  \n");
+    printf("-------------------------------------------------------------------------------------------\n");
+
+    for (int i = 0; i < tables->appointmentCount; i++) {
+        struct Appointment* a = &tables->appointments[i];
+        char* patientName = snapshotPatientName(tables->patients, tables->patientCount, a->patientId);
+        char* doctorName = getDoctorNameById(state, a->doctorId);
+
+        printf("%-7d | %-10d | %-18s | %-9d | %-18s | %-10s | %-5s\n",
+               a->id, a->patientId, patientName, a->doctorId, doctorName, a->date, a->time);
+    }
+    printf("-------------------------------------------------------------------------------------------\n");
+    free(tables);
+}
+
+void cancelAppointment(struct AppState* state) {
+    int id = getIntInput("Enter Appointment ID to cancel: ");
+    int index = findAppointmentById(state, id);
+
+    if (index == -1) {
+        printf("Appointment with ID %d not found.\n", id);
+        return;
+    }
+
+     // Confirmation
+    char confirm[10];
+    printf("Are you sure you want to cancel appointment ID %d? (yes/no): ", id);
+    getStringInput("", confirm, sizeof(confirm)); // Blank prompt
+     if (strcmp(confirm, "yes") != 0) {
+        printf("Cancellation aborted.\n");
+        return;
+    }
+
+    removeAppointmentAt(state, index);
+
+    printf("Appointment with ID %d cancelled successfully.\n", id);
+}
+
+// Page through the appointments of a date range, in date and time order
+void listAppointmentsByDate(struct AppState* state) {
+    char text[DATE_LEN];
+    struct DateEntry page[DATE_PAGE_SIZE];
+    char dateText[DATE_LEN];
+
+    printf("--- Appointments by Date ---\n");
+    getStringInput("Enter Start Date (YYYY-MM-DD, blank for today): ", text, DATE_LEN);
+    int firstDay = text[0] == '\0' ? todayDayNumber(NULL) : parseDate(text);
+    if (firstDay < 0) {
+        printf("Invalid date. Please use YYYY-MM-DD.\n");
+        return;
+    }
+    int days = getIntInput("Enter Number of Days (1 for that day only): ");
+    if (days < 1) {
+        printf("Number of days must be at least 1.\n");
+        return;
+    }
+    int doctorId = getIntInput("Enter Doctor ID (0 for all doctors): ");
+    if (doctorId != 0 && findDoctorById(state, doctorId) == -1) {
+        printf("Doctor with ID %d not found.\n", doctorId);
+        return;
+    }
+
+    // Start after every possible key of the day before
+    struct DateKey cursor = {firstDay - 1, 24 * 60, 0, 0};
+    char timeText[TIME_LEN];
+    int lastDay = firstDay + days - 1;
+    int total = 0;
+    int pageNumber = 1;
+    while (1) {
+        int count = scanDateIndex(&state->dateIndex, &cursor, lastDay, doctorId, page, DATE_PAGE_SIZE);
+        if (count == 0) break;
+        printf("\n-- Page %d --\n", pageNumber++);
+        printf("-------------------------------------------------------------------------------------------\n");
+        printf("Date       | Time  | Appt ID   | Patient Name       | Doctor Name\n");
+        printf("-------------------------------------------------------------------------------------------\n");
+        for (int i = 0; i < count; i++) {
+            struct DateKey* key = &page[i].key;
+            formatDate(key->day, dateText);
+            formatTime(key->minute, timeText);
+            printf("%-10s | %-5s | %-9d | %-18s | %s\n", dateText, timeText, key->appointmentId, getPatientNameById(state, page[i].patientId),
+                   getDoctorNameById(state, key->doctorId));
+        }
+        total += count;
+        cursor = page[count - 1].key;
+        if (count < DATE_PAGE_SIZE) break;
+
+        char more[5];
+        getStringInput("Show next page? (yes/no): ", more, sizeof(more));
+        if (strcmp(more, "yes") != 0) break;
+    }
+    if (total == 0) printf("No appointments in that range.\n");
+    else printf("%d appointment(s) listed.\n", total);
+}
+
+// --- Waiting Room (Triage Queues) ---
+// Walk-in patients wait in one queue per doctor, ordered by triage level
+// (1 = immediate ... 5 = non-urgent) and then by arrival. Each queue is a
+// 4-ary min-heap: shallower than a binary heap, and the children of a node
+// sit next to each other in the array, so a sift-down scans them in one run.
+// A patient waits in at most one queue; waitingIndex maps
+// patient ID -> (doctor, heap position) so a patient can be re-triaged or
+// removed in O(log n) without searching the queues.
+// Every change is appended to triage.log as a fixed-size event and replayed at
+// load; saveData rewrites the log with just the patients still waiting.
+
+int triageBefore(struct TriageEntry* a, struct TriageEntry* b) {
+    if (a->level != b->level) return a->level < b->level;
+    return a->sequence < b->sequence;
+}
+
+// Linear-probing hash of waiting patients (backward-shift deletion, no tombstones)
+int waitingSlotOf(int patientId) {
+    return (int)(((unsigned int)patientId * 2654435761u) % WAITING_INDEX_SLOTS);
+}
+
+struct WaitingSlot* findWaiting(struct AppState* state, int patientId) {
+    int slot = waitingSlotOf(patientId);
+    while (state->waitingIndex[slot].patientId != 0) {
+        if (state->waitingIndex[slot].patientId == patientId) return &state->waitingIndex[slot];
+        slot = (slot + 1) % WAITING_INDEX_SLOTS;
+    }
+    return NULL;
+}
+
+void addWaiting(struct AppState* state, int patientId, int doctorIndex, int position) {
+    int slot = waitingSlotOf(patientId);
+    while (state->waitingIndex[slot].patientId != 0) slot = (slot + 1) % WAITING_INDEX_SLOTS;
+    state->waitingIndex[slot].patientId = patientId;
+    state->waitingIndex[slot].doctorIndex = doctorIndex;
+    state->waitingIndex[slot].position = position;
+}
+
+void removeWaiting(struct AppState* state, int patientId) {
+    struct WaitingSlot* found = findWaiting(state, patientId);
+    if (found == NULL) return;
+    int hole = (int)(found - state->waitingIndex);
+    int slot = hole;
+    found->patientId = 0;
+    // Pull later entries of the probe run back into the hole
+    while (1) {
+        slot = (slot + 1) % WAITING_INDEX_SLOTS;
+        if (state->waitingIndex[slot].patientId == 0) return;
+        int home = waitingSlotOf(state->waitingIndex[slot].patientId);
+        int reachable = (hole <= slot) ? (home <= hole || home > slot) : (home <= hole && home > slot);
+        if (reachable) {
+            state->waitingIndex[hole] = state->waitingIndex[slot];
+            state->waitingIndex[slot].patientId = 0;
+            hole = slot;
+        }
+    }
+}
+
+// Put entry at heap position pos and record where it now lives
+void placeTriageEntry(struct AppState* state, int doctorIndex, int pos, struct TriageEntry* entry) {
+    state->triage[doctorIndex].heap[pos] = *entry;
+    struct WaitingSlot* slot = findWaiting(state, entry->patientId);
+    if (slot != NULL) slot->position = pos;
+}
+
+void siftTriageUp(struct AppState* state, int doctorIndex, int pos) {
+    struct TriageQueue* queue = &state->triage[doctorIndex];
+    struct TriageEntry entry = queue->heap[pos];
+    while (pos > 0) {
+        int parent = (pos - 1) / TRIAGE_HEAP_ARITY;
+        if (!triageBefore(&entry, &queue->heap[parent])) break;
+        placeTriageEntry(state, doctorIndex, pos, &queue->heap[parent]);
+        pos = parent;
+    }
+    placeTriageEntry(state, doctorIndex, pos, &entry);
+}
+
+void siftTriageDown(struct AppState* state, int doctorIndex, int pos) {
+    struct TriageQueue* queue = &state->triage[doctorIndex];
+    struct TriageEntry entry = queue->heap[pos];
+    while (1) {
+        int first = pos * TRIAGE_HEAP_ARITY + 1;
+        if (first >= queue->size) break;
+        int best = first;
+        int last = first + TRIAGE_HEAP_ARITY < queue->size ? first + TRIAGE_HEAP_ARITY : queue->size;
+        for (int c = first + 1; c < last; c++) {
+            if (triageBefore(&queue->heap[c], &queue->heap[best])) best = c;
+        }
+        if (!triageBefore(&queue->heap[best], &entry)) break;
+        placeTriageEntry(state, doctorIndex, pos, &queue->heap[best]);
+        pos = best;
+    }
+    placeTriageEntry(state, doctorIndex, pos, &entry);
+}
+
+// Take the entry at pos out of its queue
+void removeTriageAt(struct AppState* state, int doctorIndex, int pos) {
+    struct TriageQueue* queue = &state->triage[doctorIndex];
+    removeWaiting(state, queue->heap[pos].patientId);
+    queue->size--;
+    if (pos == queue->size) return;
+    // Move the last entry into the gap and let it settle either way
+    struct TriageEntry moved = queue->heap[queue->size];
+    placeTriageEntry(state, doctorIndex, pos, &moved);
+    siftTriageUp(state, doctorIndex, pos);
+    siftTriageDown(state, doctorIndex, findWaiting(state, moved.patientId)->position);
+}
+
+// Apply one event to the queues. Returns 0, or -1 if it does not apply
+// (unknown doctor, patient already waiting / not waiting, ...).
+int applyTriageEvent(struct AppState* state, struct TriageEvent* event) {
+    struct WaitingSlot* waiting = findWaiting(state, event->patientId);
+    if (event->sequence > state->triageSequence) state->triageSequence = event->sequence;
+
+    switch (event->op) {
+        case TRIAGE_ENQUEUE: {
+            int doctorIndex = findDoctorById(state, event->doctorId);
+            if (doctorIndex == -1 || waiting != NULL || findPatientById(state, event->patientId) == -1) return -1;
+            if (event->level < TRIAGE_LEVEL_IMMEDIATE || event->level > TRIAGE_LEVEL_LOWEST) return -1;
+            struct TriageQueue* queue = &state->triage[doctorIndex];
+            if (queue->size >= MAX_WAITING) return -1;
+            struct TriageEntry entry;
+            entry.patientId = event->patientId;
+            entry.level = event->level;
+            entry.sequence = event->sequence;
+            entry.arrived = event->timestamp;
+            int pos = queue->size++;
+            queue->heap[pos] = entry;
+            addWaiting(state, entry.patientId, doctorIndex, pos);
+            siftTriageUp(state, doctorIndex, pos);
+            return 0;
+        }
+        case TRIAGE_REPRIORITIZE: {
+            if (waiting == NULL) return -1;
+            if (event->level < TRIAGE_LEVEL_IMMEDIATE || event->level > TRIAGE_LEVEL_LOWEST) return -1;
+            int doctorIndex = waiting->doctorIndex;
+            int pos = waiting->position;
+            state->triage[doctorIndex].heap[pos].level = event->level;
+            siftTriageUp(state, doctorIndex, pos);
+            siftTriageDown(state, doctorIndex, findWaiting(state, event->patientId)->position);
+            return 0;
+        }
+        case TRIAGE_CALLED:
+        case TRIAGE_LEFT:
+            if (waiting == NULL) return -1;
+            removeTriageAt(state, waiting->doctorIndex, waiting->position);
+            return 0;
+    }
+    return -1;
+}
+
+// Apply an event and append it to triage.log
+int recordTriageEvent(struct AppState* state, struct TriageEvent* event) {
+    event->sequence = state->triageSequence + 1;
+    event->timestamp = (long long)time(NULL);
+    if (applyTriageEvent(state, event) != 0) return -1;
+    if (state->triageLog != NULL) {
+        fwrite(event, sizeof(struct TriageEvent), 1, state->triageLog);
+        fflush(state->triageLog); // One small write per event
+        state->triageRecords++;
+    }
+    return 0;
+}
+
+void closeTriageLog(struct AppState* state) {
+    if (state->triageLog != NULL) {
+        fclose(state->triageLog);
+        state->triageLog = NULL;
+    }
+}
+
+// Rewrite triage.log as one enqueue event per waiting patient (original
+// arrival order and time are kept)
+void compactTriageLog(struct AppState* state) {
+    char path[PATH_LEN], tempPath[PATH_LEN + 8];
+    buildDataPath(state, TRIAGE_FILE, path);
+    snprintf(tempPath, sizeof(tempPath), "%s.tmp", path);
+
+    closeTriageLog(state);
+    FILE* fp = fopen(tempPath, "wb");
+    if (fp == NULL) {
+        perror("Error opening triage log for writing");
+        return;
+    }
+    state->triageRecords = 0;
+    for (int d = 0; d < state->doctorCount; d++) {
+        for (int i = 0; i < state->triage[d].size; i++) {
+            struct TriageEntry* entry = &state->triage[d].heap[i];
+            struct TriageEvent event;
+            memset(&event, 0, sizeof(event));
+            event.op = TRIAGE_ENQUEUE;
+            event.patientId = entry->patientId;
+            event.doctorId = state->doctors[d].id;
+            event.level = entry->level;
+            event.sequence = entry->sequence;
+            event.timestamp = entry->arrived;
+            fwrite(&event, sizeof(event), 1, fp);
+            state->triageRecords++;
+        }
+    }
+    if (fclose(fp) != 0) {
+        perror("Error writing triage log");
+        return;
+    }
+    if (replaceFile(tempPath, path) != 0) {
+        perror("Error replacing triage log");
+        return;
+    }
+    state->triageLog = fopen(path, "ab");
+    if (state->triageLog == NULL) {
+        perror("Error opening triage log for appending");
+    }
+}
+
+// Rebuild the queues from triage.log (needs patients and doctors loaded)
+void loadTriageLog(struct AppState* state) {
+    char path[PATH_LEN];
+    struct TriageEvent event;
+    closeTriageLog(state);
+    memset(state->waitingIndex, 0, sizeof(state->waitingIndex));
+    for (int d = 0; d < MAX_DOCTORS; d++) state->triage[d].size = 0;
+    state->triageSequence = 0;
+    state->triageRecords = 0;
+
+    buildDataPath(state, TRIAGE_FILE, path);
+    FILE* fp = fopen(path, "rb");
+    if (fp != NULL) {
+        while (fread(&event, sizeof(event), 1, fp) == 1) {
+            applyTriageEvent(state, &event); // Events for removed patients/doctors are skipped
+            state->triageRecords++;
+        }
+        fclose(fp);
+    }
+    // Start from a compact log (also drops a torn last event)
+    compactTriageLog(state);
+}
+
+// Patients leave the waiting room when their record is deleted
+void removeFromWaitingRoom(struct AppState* state, int patientId) {
+    if (findWaiting(state, patientId) == NULL) return;
+    struct TriageEvent event;
+    memset(&event, 0, sizeof(event));
+    event.op = TRIAGE_LEFT;
+    event.patientId = patientId;
+    recordTriageEvent(state, &event);
+}
+
+int readTriageLevel(char* prompt) {
+    while (1) {
+        int level = getIntInput(prompt);
+        if (level >= TRIAGE_LEVEL_IMMEDIATE && level <= TRIAGE_LEVEL_LOWEST) return level;
+        printf("Triage level must be %d (immediate) to %d (non-urgent).\n",
+               TRIAGE_LEVEL_IMMEDIATE, TRIAGE_LEVEL_LOWEST);
+    }
+}
+
+void addWalkIn(struct AppState* state) {
+    if (state->patientCount == 0 || state->doctorCount == 0) {
+        printf("Patients and doctors are needed before walk-ins can be queued.\n");
+        return;
+    }
+    printf("--- Add Walk-in Patient ---\n");
+    int patientIndex = promptForPatient(state, "Enter Patient ID or Name: ");
+    if (patientIndex == -1) {
+        printf("No patient chosen.\n");
+        return;
+    }
+    int patientId = state->patients[patientIndex].id;
+    if (findWaiting(state, patientId) != NULL) {
+        printf("Patient '%s' is already waiting.\n", state->patients[patientIndex].name);
+        return;
+    }
+
+    // A doctor ID, or (part of) a specialization to join its shortest queue
+    char input[SPECIALIZATION_LEN];
+    int doctorIndex = -1;
+    viewDoctors(state);
+    while (doctorIndex == -1) {
+        int id;
+        char extra;
+        getStringInput("Enter Doctor ID or Specialization (blank to cancel): ", input, SPECIALIZATION_LEN);
+        if (input[0] == '\0') {
+            printf("No doctor chosen; nobody was queued.\n");
+            return;
+        }
+        if (sscanf(input, "%d %c", &id, &extra) == 1) {
+            doctorIndex = findDoctorById(state, id);
+        } else {
+            for (int i = 0; i < state->doctorCount; i++) {
+                if (strstr(state->doctors[i].specialization, input) != NULL
+                    && (doctorIndex == -1 || state->triage[i].size < state->triage[doctorIndex].size)) {
+                    doctorIndex = i;
+                }
+            }
+        }
+        if (doctorIndex == -1) printf("No such doctor or specialization. Please try again.\n");
+    }
+
+    struct TriageEvent event;
+    memset(&event, 0, sizeof(event));
+    event.op = TRIAGE_ENQUEUE;
+    event.patientId = patientId;
+    event.doctorId = state->doctors[doctorIndex].id;
+    event.level = readTriageLevel("Enter Triage Level (1 = immediate ... 5 = non-urgent): ");
+    if (recordTriageEvent(state, &event) != 0) {
+        printf("Dr. %s's queue is full.\n", state->doctors[doctorIndex].name);
+        return;
+    }
+    printf("Patient '%s' is waiting for Dr. %s (level %d, %d waiting).\n",
+           state->patients[patientIndex].name, state->doctors[doctorIndex].name,
+           event.level, state->triage[doctorIndex].size);
+}
+
+void callNextPatient(struct AppState* state) {
+    int doctorIndex = findDoctorById(state, getIntInput("Enter Doctor ID: "));
+    if (doctorIndex == -1) {
+        printf("Doctor not found.\n");
+        return;
+    }
+    if (state->triage[doctorIndex].size == 0) {
+        printf("Nobody is waiting for Dr. %s.\n", state->doctors[doctorIndex].name);
+        return;
+    }
+    struct TriageEntry next = state->triage[doctorIndex].heap[0];
+    struct TriageEvent event;
+    memset(&event, 0, sizeof(event));
+    event.op = TRIAGE_CALLED;
+    event.patientId = next.patientId;
+    event.doctorId = state->doctors[doctorIndex].id;
+    recordTriageEvent(state, &event);
+    long long waited = (long long)time(NULL) - next.arrived;
+    printf("Dr. %s: next patient is %s (ID: %d, level %d, waited %lld min). %d still waiting.\n",
+           state->doctors[doctorIndex].name, getPatientNameById(state, next.patientId), next.patientId,
+           next.level, waited / 60, state->triage[doctorIndex].size);
+}
+
+void changeTriageLevel(struct AppState* state) {
+    int patientId = getIntInput("Enter Patient ID: ");
+    if (findWaiting(state, patientId) == NULL) {
+        printf("Patient %d is not waiting.\n", patientId);
+        return;
+    }
+    struct TriageEvent event;
+    memset(&event, 0, sizeof(event));
+    event.op = TRIAGE_REPRIORITIZE;
+    event.patientId = patientId;
+    event.level = readTriageLevel("Enter New Triage Level (1-5): ");
+    recordTriageEvent(state, &event);
+
+    struct WaitingSlot* waiting = findWaiting(state, patientId);
+    struct TriageQueue* queue = &state->triage[waiting->doctorIndex];
+    int ahead = 0;
+    for (int i = 0; i < queue->size; i++) {
+        if (triageBefore(&queue->heap[i], &queue->heap[waiting->position])) ahead++;
+    }
+    printf("Patient %d is now level %d with %d patient(s) ahead for Dr. %s.\n", patientId, event.level,
+           ahead, state->doctors[waiting->doctorIndex].name);
+}
+
+void removeWalkIn(struct AppState* state) {
+    int patientId = getIntInput("Enter Patient ID: ");
+    if (findWaiting(state, patientId) == NULL) {
+        printf("Patient %d is not waiting.\n", patientId);
+        return;
+    }
+    removeFromWaitingRoom(state, patientId);
+    printf("Patient %d removed from the waiting room.\n", patientId);
+}
+
+int compareTriageEntries(const void* a, const void* b) {
+    struct TriageEntry* x = (struct TriageEntry*)a;
+    struct TriageEntry* y = (struct TriageEntry*)b;
+    if (triageBefore(x, y)) return -1;
+    return triageBefore(y, x) ? 1 : 0;
+}
+
+void viewWaitingRoom(struct AppState* state) {
+    struct TriageEntry sorted[MAX_WAITING];
+    int total = 0;
+    long long now = (long long)time(NULL);
+    printf("\n--- Waiting Room ---\n");
+    for (int d = 0; d < state->doctorCount; d++) {
+        struct TriageQueue* queue = &state->triage[d];
+        if (queue->size == 0) continue;
+        // Copy the heap and sort it for display; the queue itself stays a heap
+        memcpy(sorted, queue->heap, sizeof(struct TriageEntry) * queue->size);
+        qsort(sorted, queue->size, sizeof(struct TriageEntry), compareTriageEntries);
+        printf("Dr. %s (%s) - %d waiting\n", state->doctors[d].name, state->doctors[d].specialization, queue->size);
+        printf("  #  | Level | Patient ID | Patient Name         | Waiting\n");
+        for (int i = 0; i < queue->size; i++) {
+            printf("  %-2d | %-5d | %-10d | %-20s | %lld min\n", i + 1, sorted[i].level, sorted[i].patientId,
+                   getPatientNameById(state, sorted[i].patientId), (now - sorted[i].arrived) / 60);
+        }
+        total += queue->size;
+    }
+    if (total == 0) printf("Nobody is waiting.\n");
+}
+
+// --- Archive (Cold Tier) ---
+// Appointments older than a cutoff and bills past their retention age move out
+// of the hot tables into append-only archive segments, so the tables that are
+// viewed, searched and saved all the time stay small.
+// A segment holds the records of one table sorted by ID, in blocks of
+// ARCHIVE_BLOCK_RECORDS. Inside a block IDs are delta-encoded and every number
+// is a varint (dates and times become day/minute numbers, money becomes
+// cents), which shrinks a record to roughly a quarter of its fixed size.
+// The footer is a sparse index with one entry per block: its ID range and a
+// 64-bit patient mask (bit patientId % 64). Only that index is kept in memory;
+// a lookup by ID reads one block, a lookup by patient reads only the blocks
+// whose mask has the patient's bit.
+
+void putVarint(struct TableFile* f, unsigned long long value) {
+    unsigned char bytes[10];
+    int n = 0;
+    while (value >= 0x80) {
+        bytes[n++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    bytes[n++] = (unsigned char)value;
+    writeImage(bytes, 1, n, f);
+}
+
+unsigned long long zigzag(long long value) {
+    return ((unsigned long long)value << 1) ^ (unsigned long long)(value >> 63);
+}
+
+long long unzigzag(unsigned long long value) {
+    return (long long)(value >> 1) ^ -(long long)(value & 1);
+}
+
+struct ByteReader {
+    unsigned char* data;
+    size_t length;
+    size_t position;
+    int bad; // Ran past the end
+};
+
+unsigned long long getVarint(struct ByteReader* r) {
+    unsigned long long value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (r->position >= r->length) {
+            r->bad = 1;
+            return 0;
+        }
+        unsigned char b = r->data[r->position++];
+        value |= (unsigned long long)(b & 0x7F) << shift;
+        if (!(b & 0x80)) return value;
+    }
+    r->bad = 1;
+    return 0;
+}
+
+void putArchiveString(struct TableFile* f, char* text) {
+    size_t len = strlen(text);
+    putVarint(f, len);
+    writeImage(text, 1, len, f);
+}
+
+void getArchiveString(struct ByteReader* r, char* out, int outLen) {
+    size_t len = getVarint(r);
+    if (r->bad || len > r->length - r->position || (int)len >= outLen) {
+        r->bad = 1;
+        out[0] = '\0';
+        return;
+    }
+    memcpy(out, r->data + r->position, len);
+    out[len] = '\0';
+    r->position += len;
+}
+
+// A date as zigzag(day) + 1, or 0 followed by the text when it is not a
+// canonical YYYY-MM-DD date (so every record comes back byte for byte)
+void putArchiveDate(struct TableFile* f, char* date) {
+    char canonical[DATE_LEN];
+    int day = parseDate(date);
+    if (day != -1) formatDate(day, canonical);
+    if (day != -1 && strcmp(canonical, date) == 0) {
+        putVarint(f, zigzag(day) + 1);
+    } else {
+        putVarint(f, 0);
+        putArchiveString(f, date);
+    }
+}
+
+void getArchiveDate(struct ByteReader* r, char* out) {
+    unsigned long long value = getVarint(r);
+    if (value == 0) getArchiveString(r, out, DATE_LEN);
+    else formatDate((int)unzigzag(value - 1), out);
+}
+
+// HH:MM as minutes + 1, or 0 followed by the text
+void putArchiveTime(struct TableFile* f, char* text) {
+    char canonical[TIME_LEN];
+    int minute = parseTime(text);
+    formatTime(minute, canonical);
+    if (minute >= 0 && strcmp(canonical, text) == 0) {
+        putVarint(f, minute + 1);
+    } else {
+        putVarint(f, 0);
+        putArchiveString(f, text);
+    }
+}
+
+void getArchiveTime(struct ByteReader* r, char* out) {
+    unsigned long long value = getVarint(r);
+    if (value == 0) getArchiveString(r, out, TIME_LEN);
+    else formatTime((int)(value - 1), out);
+}
+
+// An amount as cents (low bit 0) when that reproduces the float exactly,
+// otherwise its raw bits (low bit 1)
+void putArchiveAmount(struct TableFile* f, float amount) {
+    long long cents = toCents(amount);
+    if ((float)(cents / 100.0) == amount) {
+        putVarint(f, zigzag(cents) << 1);
+    } else {
+        unsigned int bits;
+        memcpy(&bits, &amount, sizeof(bits));
+        putVarint(f, ((unsigned long long)bits << 1) | 1);
+    }
+}
+
+float getArchiveAmount(struct ByteReader* r) {
+    unsigned long long value = getVarint(r);
+    if (value & 1) {
+        unsigned int bits = (unsigned int)(value >> 1);
+        float amount;
+        memcpy(&amount, &bits, sizeof(amount));
+        return amount;
+    }
+    return (float)(unzigzag(value >> 1) / 100.0);
+}
+
+int archiveRecordId(int table, void* records, int i) {
+    return table == TABLE_APPOINTMENT ? ((struct Appointment*)records)[i].id : ((struct Bill*)records)[i].id;
+}
+
+int archivePatientId(int table, void* records, int i) {
+    return table == TABLE_APPOINTMENT ? ((struct Appointment*)records)[i].patientId : ((struct Bill*)records)[i].patientId;
+}
+
+unsigned long long patientMaskBit(int patientId) {
+    return 1ULL << ((unsigned int)patientId % 64);
+}
+
+void encodeArchiveRecord(struct TableFile* f, int table, void* records, int i, int previousId) {
+    if (table == TABLE_APPOINTMENT) {
+        struct Appointment* a = &((struct Appointment*)records)[i];
+        putVarint(f, zigzag((long long)a->id - previousId));
+        putVarint(f, zigzag(a->patientId));
+        putVarint(f, zigzag(a->doctorId));
+        putArchiveDate(f, a->date);
+        putArchiveTime(f, a->time);
+    } else {
+        struct Bill* b = &((struct Bill*)records)[i];
+        putVarint(f, zigzag((long long)b->id - previousId));
+        putVarint(f, zigzag(b->patientId));
+        putVarint(f, zigzag(b->doctorId));
+        putArchiveAmount(f, b->doctorFee);
+        putArchiveAmount(f, b->totalAmount);
+        putArchiveDate(f, b->dateGenerated);
+    }
+}
+
+int decodeArchiveRecord(struct ByteReader* r, int table, void* out, int previousId) {
+    if (table == TABLE_APPOINTMENT) {
+        struct Appointment* a = (struct Appointment*)out;
+        memset(a, 0, sizeof(*a));
+        a->id = (int)(previousId + unzigzag(getVarint(r)));
+        a->patientId = (int)unzigzag(getVarint(r));
+        a->doctorId = (int)unzigzag(getVarint(r));
+        getArchiveDate(r, a->date);
+        getArchiveTime(r, a->time);
+        return a->id;
+    }
+    struct Bill* b = (struct Bill*)out;
+    memset(b, 0, sizeof(*b));
+    b->id = (int)(previousId + unzigzag(getVarint(r)));
+    b->patientId = (int)unzigzag(getVarint(r));
+    b->doctorId = (int)unzigzag(getVarint(r));
+    b->doctorFee = getArchiveAmount(r);
+    b->totalAmount = getArchiveAmount(r);
+    getArchiveDate(r, b->dateGenerated);
+    return b->id;
+}
+
+void archiveSegmentName(int table, int number, char* out) {
+    snprintf(out, PATH_LEN, "%s/%s-%06d.seg", ARCHIVE_DIR,
+             table == TABLE_APPOINTMENT ? "appointments" : "bills", number);
+}
+
+// Read a segment's header and sparse index into memory
+int loadArchiveSegment(struct AppState* state, int table, int number) {
+    char name[PATH_LEN];
+    struct ArchiveSegmentHeader header;
+    struct ArchiveSegment* segment = &state->archiveSegments[state->archiveSegmentCount];
+    if (state->archiveSegmentCount >= MAX_ARCHIVE_SEGMENTS) return -1;
+
+    archiveSegmentName(table, number, name);
+    FILE* fp = openDataFile(state, name, "rb");
+    if (fp == NULL) return -1;
+    int ok = fread(&header, sizeof(header), 1, fp) == 1
+             && memcmp(header.magic, ARCHIVE_MAGIC, 4) == 0 && header.table == table
+             && header.blockCount >= 0
+             && state->archiveBlockCount + header.blockCount <= MAX_ARCHIVE_BLOCKS
+             && fseek(fp, (long)header.indexOffset, SEEK_SET) == 0
+             && fread(&state->archiveBlocks[state->archiveBlockCount], sizeof(struct ArchiveBlock),
+                      header.blockCount, fp) == (size_t)header.blockCount;
+    fclose(fp);
+    if (!ok) return -1;
+
+    segment->table = table;
+    segment->number = number;
+    segment->recordCount = header.recordCount;
+    segment->minId = header.minId;
+    segment->maxId = header.maxId;
+    segment->createdAt = header.createdAt;
+    segment->firstBlock = state->archiveBlockCount;
+    segment->blockCount = header.blockCount;
+    state->archiveBlockCount += header.blockCount;
+    state->archiveSegmentCount++;
+    return 0;
+}
+
+// The catalog lists the segments in the order they were written
+void loadArchiveCatalog(struct AppState* state) {
+    char name[PATH_LEN];
+    int entry[2]; // table, segment number
+    state->archiveSegmentCount = 0;
+    state->archiveBlockCount = 0;
+    state->archiveNextSegment = 1;
+
+    snprintf(name, PATH_LEN, "%s/%s", ARCHIVE_DIR, ARCHIVE_CATALOG_FILE);
+    FILE* fp = openDataFile(state, name, "rb");
+    if (fp == NULL) return; // Nothing archived yet
+    while (fread(entry, sizeof(int), 2, fp) == 2) {
+        if (entry[1] >= state->archiveNextSegment) state->archiveNextSegment = entry[1] + 1;
+        if (loadArchiveSegment(state, entry[0], entry[1]) != 0) {
+            printf("Warning: Archive segment %d could not be read; its records are not searchable.\n", entry[1]);
+        }
+    }
+    fclose(fp);
+}
+
+// Write one segment of records (sorted by ID) and add it to the catalog
+int writeArchiveSegment(struct AppState* state, int table, void* records, int count) {
+    struct TableFile file;
+    struct ArchiveSegmentHeader header;
+    struct ArchiveBlock blocks[MAX_APPOINTMENTS > MAX_BILLS ? MAX_APPOINTMENTS : MAX_BILLS];
+    char name[PATH_LEN], dir[PATH_LEN];
+    int number = state->archiveNextSegment;
+    int blocksNeeded = (count + ARCHIVE_BLOCK_RECORDS - 1) / ARCHIVE_BLOCK_RECORDS;
+
+    // A segment that could not be indexed would be unsearchable, so check first
+    if (state->archiveSegmentCount >= MAX_ARCHIVE_SEGMENTS
+        || state->archiveBlockCount + blocksNeeded > MAX_ARCHIVE_BLOCKS) {
+        printf("Error: The archive index is full (%d segments, %d blocks); the records stay in the working tables.\n",
+               state->archiveSegmentCount, state->archiveBlockCount);
+        return -1;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ARCHIVE_MAGIC, 4);
+    header.table = table;
+    header.recordCount = count;
+    header.minId = archiveRecordId(table, records, 0);
+    header.maxId = archiveRecordId(table, records, count - 1);
+    header.createdAt = (long long)time(NULL);
+
+    archiveSegmentName(table, number, name);
+    initTableFile(&file, name);
+    writeImage(&header, sizeof(header), 1, &file); // Rewritten below once the index offset is known
+
+    for (int start = 0; start < count; start += ARCHIVE_BLOCK_RECORDS) {
+        struct ArchiveBlock* block = &blocks[header.blockCount++];
+        int end = start + ARCHIVE_BLOCK_RECORDS < count ? start + ARCHIVE_BLOCK_RECORDS : count;
+        int previousId = 0;
+        block->offset = file.length;
+        block->firstId = archiveRecordId(table, records, start);
+        block->lastId = archiveRecordId(table, records, end - 1);
+        block->count = end - start;
+        block->patientMask = 0;
+        for (int i = start; i < end; i++) {
+            encodeArchiveRecord(&file, table, records, i, previousId);
+            previousId = archiveRecordId(table, records, i);
+            block->patientMask |= patientMaskBit(archivePatientId(table, records, i));
+        }
+        block->length = (int)(file.length - block->offset);
+    }
+    header.indexOffset = file.length;
+    writeImage(blocks, sizeof(struct ArchiveBlock), header.blockCount, &file);
+    if (file.failed) {
+        freeTableFile(&file);
+        printf("Error: Not enough memory to build an archive segment.\n");
+        return -1;
+    }
+    memcpy(file.data, &header, sizeof(header));
+
+    buildDataPath(state, ARCHIVE_DIR, dir);
+    makeDirectory(dir);
+    int rc = runTableBatch(state, &file, 1, 1);
+    freeTableFile(&file);
+    if (rc != 0) return -1;
+    if (loadArchiveSegment(state, table, number) != 0) {
+        printf("Error: Archive segment %d was written but could not be read back.\n", number);
+        return -1;
+    }
+
+    // Only segments listed in the catalog exist as far as queries are concerned
+    int entry[2] = { table, number };
+    snprintf(name, PATH_LEN, "%s/%s", ARCHIVE_DIR, ARCHIVE_CATALOG_FILE);
+    FILE* fp = openDataFile(state, name, "ab");
+    int written = fp != NULL && fwrite(entry, sizeof(int), 2, fp) == 2;
+    if (fp != NULL && fclose(fp) != 0) written = 0;
+    if (!written) {
+        perror("Error updating archive catalog");
+        state->archiveSegmentCount--;
+        state->archiveBlockCount -= header.blockCount;
+        return -1;
+    }
+    state->archiveNextSegment = number + 1;
+    return 0;
+}
+
+// Read and decode one block. Returns the record count, or -1.
+int readArchiveBlock(FILE* fp, int table, struct ArchiveBlock* block, void* out) {
+    struct ByteReader reader;
+    if (block->count < 0 || block->count > ARCHIVE_BLOCK_RECORDS || block->length <= 0) return -1;
+    unsigned char* data = malloc(block->length);
+    if (data == NULL) return -1;
+    if (fseek(fp, (long)block->offset, SEEK_SET) != 0 || fread(data, 1, block->length, fp) != (size_t)block->length) {
+        free(data);
+        return -1;
+    }
+    reader.data = data;
+    reader.length = block->length;
+    reader.position = 0;
+    reader.bad = 0;
+    int previousId = 0;
+    size_t recordSize = table == TABLE_APPOINTMENT ? sizeof(struct Appointment) : sizeof(struct Bill);
+    for (int i = 0; i < block->count && !reader.bad; i++) {
+        previousId = decodeArchiveRecord(&reader, table, (char*)out + i * recordSize, previousId);
+    }
+    free(data);
+    return reader.bad ? -1 : block->count;
+}
+
+FILE* openArchiveSegment(struct AppState* state, struct ArchiveSegment* segment) {
+    char name[PATH_LEN];
+    archiveSegmentName(segment->table, segment->number, name);
+    return openDataFile(state, name, "rb");
+}
+
+// Remove a record from a hot table without logging or publishing it.
+// Returns 1 if it was there.
+int dropHotRecord(struct AppState* state, int table, int id) {
+    void* rows = table == TABLE_APPOINTMENT ? (void*)state->appointments : (void*)state->bills;
+    int* count = table == TABLE_APPOINTMENT ? &state->appointmentCount : &state->billCount;
+    size_t recordSize = table == TABLE_APPOINTMENT ? sizeof(struct Appointment) : sizeof(struct Bill);
+    for (int i = 0; i < *count; i++) {
+        if (archiveRecordId(table, rows, i) != id) continue;
+        memmove((char*)rows + i * recordSize, (char*)rows + (i + 1) * recordSize, (*count - i - 1) * recordSize);
+        (*count)--;
+        return 1;
+    }
+    return 0;
+}
+
+// Archiving lists a segment in the catalog before it saves the smaller
+// tables, so a crash in between leaves records both archived and hot. The
+// counters remember which segments the saved tables already reflect; records
+// of any later segment are taken out of the tables as they load.
+void dropArchivedHotRecords(struct AppState* state) {
+    struct Bill bills[ARCHIVE_BLOCK_RECORDS];
+    struct Appointment appointments[ARCHIVE_BLOCK_RECORDS];
+    int dropped = 0;
+
+    for (int s = 0; s < state->archiveSegmentCount; s++) {
+        struct ArchiveSegment* segment = &state->archiveSegments[s];
+        if (segment->number < state->archiveCheckpoint) continue;
+        void* records = segment->table == TABLE_APPOINTMENT ? (void*)appointments : (void*)bills;
+        FILE* fp = openArchiveSegment(state, segment);
+        if (fp == NULL) continue;
+        for (int b = 0; b < segment->blockCount; b++) {
+            int count = readArchiveBlock(fp, segment->table, &state->archiveBlocks[segment->firstBlock + b], records);
+            for (int i = 0; i < count; i++) {
+                dropped += dropHotRecord(state, segment->table, archiveRecordId(segment->table, records, i));
+            }
+        }
+        fclose(fp);
+    }
+    if (dropped > 0) {
+        printf("Note: %d archived record(s) were still in the working tables (archiving was interrupted) and were removed.\n", dropped);
+    }
+}
+
+// Find an archived record by ID (out is a struct Appointment or struct Bill).
+// Returns 0 if found.
+int findArchivedRecord(struct AppState* state, int table, int id, void* out) {
+    struct Bill bills[ARCHIVE_BLOCK_RECORDS];
+    struct Appointment appointments[ARCHIVE_BLOCK_RECORDS];
+    void* records = table == TABLE_APPOINTMENT ? (void*)appointments : (void*)bills;
+    size_t recordSize = table == TABLE_APPOINTMENT ? sizeof(struct Appointment) : sizeof(struct Bill);
+
+    for (int s = 0; s < state->archiveSegmentCount; s++) {
+        struct ArchiveSegment* segment = &state->archiveSegments[s];
+        if (segment->table != table || id < segment->minId || id > segment->maxId) continue;
+
+        // Binary search the sparse index for the block whose range holds id
+        struct ArchiveBlock* blocks = &state->archiveBlocks[segment->firstBlock];
+        int low = 0, high = segment->blockCount - 1, found = -1;
+        while (low <= high) {
+            int mid = (low + high) / 2;
+            if (id < blocks[mid].firstId) high = mid - 1;
+            else if (id > blocks[mid].lastId) low = mid + 1;
+            else { found = mid; break; }
+        }
+        if (found == -1) continue;
+
+        FILE* fp = openArchiveSegment(state, segment);
+        if (fp == NULL) continue;
+        int count = readArchiveBlock(fp, table, &blocks[found], records);
+        fclose(fp);
+        for (int i = 0; i < count; i++) {
+            if (archiveRecordId(table, records, i) == id) {
+                memcpy(out, (char*)records + i * recordSize, recordSize);
+                return 0;
+            }
+        }
+    }
+    return -1;
+}
+
+int findArchivedAppointment(struct AppState* state, int id, struct Appointment* out) {
+    return findArchivedRecord(state, TABLE_APPOINTMENT, id, out);
+}
+
+int findArchivedBill(struct AppState* state, int id, struct Bill* out) {
+    return findArchivedRecord(state, TABLE_BILL, id, out);
+}
+
+void printArchivedAppointment(struct AppState* state, struct Appointment* a) {
+    printf("%-7d | %-10d | %-18s | %-9d | %-18s | %-10s | %-5s\n", a->id, a->patientId,
+           getPatientNameById(state, a->patientId), a->doctorId, getDoctorNameById(state, a->doctorId),
+           a->date, a->time);
+}
+
+void printArchivedBill(struct AppState* state, struct Bill* b) {
+    printf("%-7d | %-10d | %-18s | %-10.2f | %-12.2f | %-10s\n", b->id, b->patientId,
+           getPatientNameById(state, b->patientId), b->doctorFee, b->totalAmount, b->dateGenerated);
+}
+
+// All archived records of one table for a patient, oldest segment first
+int listArchivedForPatient(struct AppState* state, int table, int patientId) {
+    struct Bill bills[ARCHIVE_BLOCK_RECORDS];
+    struct Appointment appointments[ARCHIVE_BLOCK_RECORDS];
+    void* records = table == TABLE_APPOINTMENT ? (void*)appointments : (void*)bills;
+    unsigned long long bit = patientMaskBit(patientId);
+    int found = 0, blocksRead = 0;
+
+    for (int s = 0; s < state->archiveSegmentCount; s++) {
+        struct ArchiveSegment* segment = &state->archiveSegments[s];
+        if (segment->table != table) continue;
+        FILE* fp = NULL;
+        for (int b = 0; b < segment->blockCount; b++) {
+            struct ArchiveBlock* block = &state->archiveBlocks[segment->firstBlock + b];
+            if (!(block->patientMask & bit)) continue; // Patient cannot be in this block
+            if (fp == NULL && (fp = openArchiveSegment(state, segment)) == NULL) break;
+            int count = readArchiveBlock(fp, table, block, records);
+            blocksRead++;
+            for (int i = 0; i < count; i++) {
+                if (archivePatientId(table, records, i) != patientId) continue;
+                if (table == TABLE_APPOINTMENT) printArchivedAppointment(state, &appointments[i]);
+                else printArchivedBill(state, &bills[i]);
+                found++;
+            }
+        }
+        if (fp != NULL) fclose(fp);
+    }
+    return found;
+}
+
+int compareAppointmentIds(const void* a, const void* b) {
+    return ((struct Appointment*)a)->id - ((struct Appointment*)b)->id;
+}
+
+int compareBillIds(const void* a, const void* b) {
+    return ((struct Bill*)a)->id - ((struct Bill*)b)->id;
+}
+
+// Move appointments dated before appointmentCutoff and bills dated before
+// billCutoff (day numbers) into new segments, then save the smaller tables.
+// Records whose date does not parse stay hot. Returns -1 on failure.
+int archiveOldRecords(struct AppState* state, int appointmentCutoff, int billCutoff,
+                      int* movedAppointments, int* movedBills) {
+    struct Appointment oldAppointments[MAX_APPOINTMENTS];
+    struct Bill oldBills[MAX_BILLS];
+    int appointmentCount = 0, billCount = 0;
+
+    for (int i = 0; i < state->appointmentCount; i++) {
+        int day = parseDate(state->appointments[i].date);
+        if (day != -1 && day < appointmentCutoff) oldAppointments[appointmentCount++] = state->appointments[i];
+    }
+    for (int i = 0; i < state->billCount; i++) {
+        int day = parseDate(state->bills[i].dateGenerated);
+        if (day != -1 && day < billCutoff) oldBills[billCount++] = state->bills[i];
+    }
+    int rc = 0;
+    *movedAppointments = 0;
+    *movedBills = 0;
+
+    // Records leave the hot tables only once their segment is safely written
+    if (appointmentCount > 0) {
+        qsort(oldAppointments, appointmentCount, sizeof(struct Appointment), compareAppointmentIds);
+        if (writeArchiveSegment(state, TABLE_APPOINTMENT, oldAppointments, appointmentCount) != 0) {
+            rc = -1;
+            appointmentCount = 0;
+        }
+    }
+    if (appointmentCount > 0) {
+        for (int i = state->appointmentCount - 1; i >= 0; i--) {
+            int day = parseDate(state->appointments[i].date);
+            if (day != -1 && day < appointmentCutoff) removeAppointmentAs(state, i, CDC_ARCHIVE);
+        }
+        *movedAppointments = appointmentCount;
+    }
+    if (billCount > 0) {
+        qsort(oldBills, billCount, sizeof(struct Bill), compareBillIds);
+        if (writeArchiveSegment(state, TABLE_BILL, oldBills, billCount) != 0) {
+            rc = -1;
+            billCount = 0;
+        }
+    }
+    if (billCount > 0) {
+        for (int i = state->billCount - 1; i >= 0; i--) {
+            int day = parseDate(state->bills[i].dateGenerated);
+            if (day != -1 && day < billCutoff) removeBillAs(state, i, CDC_ARCHIVE);
+        }
+        *movedBills = billCount;
+    }
+    // Save right away. Until the save lands the saved tables still hold the
+    // moved records; loading drops them again (see dropArchivedHotRecords).
+    if (appointmentCount + billCount > 0 && saveData(state) != 0) rc = -1;
+    return rc;
+}
+
+void archiveOldRecordsMenu(struct AppState* state) {
+    printf("--- Archive Old Records ---\n");
+    int appointmentDays = getIntInput("Archive appointments older than how many days? (e.g., 90): ");
+    int billDays = getIntInput("Archive bills older than how many days? (e.g., 365): ");
+    if (appointmentDays < 0 || billDays < 0) {
+        printf("Ages must be 0 days or more.\n");
+        return;
+    }
+    int today = todayDayNumber(NULL);
+    int movedAppointments, movedBills;
+    if (archiveOldRecords(state, today - appointmentDays, today - billDays, &movedAppointments, &movedBills) != 0) {
+        printf("Warning: Archiving did not complete; see the messages above.\n");
+    }
+    printf("Archived %d appointment(s) and %d bill(s). Hot tables now hold %d appointment(s) and %d bill(s).\n",
+           movedAppointments, movedBills, state->appointmentCount, state->billCount);
+}
+
+void findArchivedRecordMenu(struct AppState* state) {
+    int id = getIntInput("Enter Appointment or Bill ID: ");
+    struct Appointment a;
+    struct Bill b;
+    int found = 0;
+    if (findArchivedAppointment(state, id, &a) == 0) {
+        printf("Archived appointment:\n");
+        printArchivedAppointment(state, &a);
+        found = 1;
+    }
+    if (findArchivedBill(state, id, &b) == 0) {
+        printf("Archived bill:\n");
+        printArchivedBill(state, &b);
+        found = 1;
+    }
+    if (!found) printf("ID %d is not in the archive.\n", id);
+}
+
+void patientArchiveMenu(struct AppState* state) {
+    int patientId = getIntInput("Enter Patient ID: ");
+    printf("\n--- Archived Appointments of Patient %d ---\n", patientId);
+    printf("Appt ID | Patient ID | Patient Name       | Doctor ID | Doctor Name        | Date       | Time  \n");
+    int appointments = listArchivedForPatient(state, TABLE_APPOINTMENT, patientId);
+    printf("\n--- Archived Bills of Patient %d ---\n", patientId);
+    printf("Bill ID | Patient ID | Patient Name       | Doctor Fee | Total Amount | Date      \n");
+    int bills = listArchivedForPatient(state, TABLE_BILL, patientId);
+    printf("%d archived appointment(s), %d archived bill(s).\n", appointments, bills);
+}
+
+void listArchiveSegments(struct AppState* state) {
+    char created[32];
+    printf("\n--- Archive Segments (%d) ---\n", state->archiveSegmentCount);
+    if (state->archiveSegmentCount == 0) {
+        printf("Nothing has been archived yet.\n");
+        return;
+    }
+    printf("Segment | Table        | Records | Blocks | ID Range              | Created\n");
+    for (int s = 0; s < state->archiveSegmentCount; s++) {
+        struct ArchiveSegment* segment = &state->archiveSegments[s];
+        formatTimestamp(segment->createdAt, created, sizeof(created));
+        printf("%-7d | %-12s | %-7d | %-6d | %-10d - %-10d | %s\n", segment->number,
+               segment->table == TABLE_APPOINTMENT ? "Appointments" : "Bills",
+               segment->recordCount, segment->blockCount, segment->minId, segment->maxId, created);
+    }
+}
+
+// --- Billing Functions (Operate on AppState) ---
+
+int findBillById(struct AppState* state, int id) {
+    for (int i = 0; i < state->billCount; i++) {
+        if (state->bills[i].id == id) {
+            return i; // Return index
+        }
+    }
+    return -1; // Not found
+}
+
+
+void generateBill(struct AppState* state) {
+    if (state->billCount >= MAX_BILLS) {
+        printf("Maximum bill limit reached.\n");
+        return;
+    }
+    if (branchIdsUsedUp(state, state->nextBillId, "bill")) return;
+     if (state->patientCount == 0) {
+        printf("No patients in the system to bill.\n");
+        return;
+    }
+
+    struct Bill b; // Use 'struct Bill'
+    int doctorId = -1;
+    int patientIndex, doctorIndex = -1;
+
+    printf("--- Generate New Bill ---\n");
+
+    // Get and validate Patient (by ID, or by name with typo-tolerant search)
+    patientIndex = promptForPatient(state, "Enter Patient ID or Name for the bill: ");
+    if (patientIndex == -1) {
+        printf("No patient chosen; bill not generated.\n");
+        return;
+    }
+    b.id = state->nextBillId++;
+    b.patientId = state->patients[patientIndex].id;
+
+    // Optionally, link to a specific doctor for the fee
+    char linkDoctor[5];
+    printf("Is this bill related to a specific doctor consultation? (yes/no): ");
+    getStringInput("", linkDoctor, sizeof(linkDoctor)); // Blank prompt
+    if(strcmp(linkDoctor, "yes") == 0 && state->doctorCount > 0) { // Check if doctors exist
+        viewDoctors(state);
+         while (1) {
+            doctorId = getIntInput("Enter Doctor ID for the consultation fee: ");
+            doctorIndex = findDoctorById(state, doctorId);
+            if (doctorIndex != -1) {
+                b.doctorId = doctorId;
+                break;
+            } else {
+                 printf("Invalid Doctor ID. Please try again.\n");
+            }
+        }
+         b.doctorFee = getFloatInput("Enter Doctor Consultation Fee: ");
+    } else {
+        if(strcmp(linkDoctor, "yes") == 0 && state->doctorCount == 0) {
+            printf("Cannot link doctor fee, no doctors in the system.\n");
+        }
+        b.doctorId = -1; // Indicate no specific doctor linked or fee from doctor
+        b.doctorFee = 0.0;
+    }
+
+    // Get Bill Date
+    getStringInput("Enter Bill Date (YYYY-MM-DD): ", b.dateGenerated, DATE_LEN);
+
+    // Calculate Total
+    b.totalAmount = b.doctorFee; // Add other costs if implemented
+
+    insertBillRecord(state, &b);
+    printf("Bill generated successfully for Patient %s (Bill ID: %d)\n",
+           state->patients[patientIndex].name, b.id);
+    printf("Total Amount: %.2f\n", b.totalAmount);
+}
+
+// Format one invoice into buf (shared by printInvoice and batch statements)
+int formatInvoice(struct TextBuffer* buf, struct Bill* b, struct Patient* p, char* doctorName) {
+    int rc = 0;
+    rc |= appendText(buf, "\n\n--- HOSPITAL INVOICE ---\n");
+    rc |= appendText(buf, "----------------------------------------\n");
+    rc |= appendText(buf, " Bill ID       : %d\n", b->id);
+    rc |= appendText(buf, " Bill Date     : %s\n", b->dateGenerated);
+    rc |= appendText(buf, "----------------------------------------\n");
+    rc |= appendText(buf, " Patient Details:\n");
+    rc |= appendText(buf, "   Patient ID  : %d\n", p->id);
+    rc |= appendText(buf, "   Name        : %s\n", p->name);
+    rc |= appendText(buf, "   Age         : %d\n", p->age);
+    rc |= appendText(buf, "   Gender      : %s\n", p->gender);
+    rc |= appendText(buf, "   Contact     : %s\n", p->contact);
+    rc |= appendText(buf, "----------------------------------------\n");
+    rc |= appendText(buf, " Charges:\n");
+    if (b->doctorId != -1) {
+       rc |= appendText(buf, "   Doctor Fee (Dr. %s): %.2f\n", doctorName, b->doctorFee);
+    }
+    // Add lines for medicine, tests etc. if implemented
+    rc |= appendText(buf, "----------------------------------------\n");
+    rc |= appendText(buf, " Total Amount  : %.2f\n", b->totalAmount);
+    rc |= appendText(buf, "----------------------------------------\n");
+    rc |= appendText(buf, " Thank you!\n");
+    rc |= appendText(buf, "----------------------------------------\n\n");
+    return rc;
+}
+
+void printInvoice(struct AppState* state) {
+    int billId = getIntInput("Enter Bill ID to print invoice: ");
+    int billIndex = findBillById(state, billId);
+    struct Bill b;
+
+    if (billIndex != -1) {
+        b = state->bills[billIndex];
+    } else if (findArchivedBill(state, billId, &b) == 0) {
+        printf("(Bill %d is archived.)\n", billId);
+    } else {
+        printf("Bill with ID %d not found.\n", billId);
+        return;
+    }
+
+    int patientIndex = findPatientById(state, b.patientId);
+
+    if (patientIndex == -1) {
+        printf("Error: Patient associated with this bill (ID: %d) not found!\n", b.patientId);
+        return; // Cannot print invoice without patient details
+    }
+    struct Patient p = state->patients[patientIndex];
+    char* doctorName = (b.doctorId != -1) ? getDoctorNameById(state, b.doctorId) : "N/A";
+
+    struct TextBuffer buf;
+    initTextBuffer(&buf);
+    if (formatInvoice(&buf, &b, &p, doctorName) != 0) {
+        printf("Error: Out of memory while formatting invoice.\n");
+    } else {
+        fputs(buf.data, stdout);
+    }
+    freeTextBuffer(&buf);
+}
+
+void viewBills(struct AppState* state) {
+    struct TableSnapshot* tables = takeTableSnapshot(state); // Consistent while bills are added
+    if (tables == NULL) return;
+    printf("\n--- Bill List (%d) ---\n", tables->billCount);
+    if (tables->billCount == 0) {
+        printf("No bills generated yet.\n");
+        free(tables);
+        return;
+    }
+    printf("-----------------------------------------------------------------------------\n");
+    printf("Bill ID | Patient ID | Patient Name       | Doctor Fee | Total Amount | Date \n");
+    printf("-----------------------------------------------------------------------------\n");
+    for (int i = 0; i < tables->billCount; i++) {
+        struct Bill* b = &tables->bills[i];
+        char* patientName = snapshotPatientName(tables->patients, tables->patientCount, b->patientId);
+        printf("%-7d | %-10d | %-18s | %-10.2f | %-12.2f | %-10s\n",
+               b->id, b->patientId, patientName, b->doctorFee, b->totalAmount, b->dateGenerated);
+    }
+     printf("-----------------------------------------------------------------------------\n");
+    free(tables);
+}
+
+// Bill count and revenue over the whole bill table
+void viewRevenueTotals(struct AppState* state) {
+    struct TableSnapshot* tables = takeTableSnapshot(state);
+    if (tables == NULL) return;
+    double total = 0, doctorFees = 0;
+    for (int i = 0; i < tables->billCount; i++) {
+        total += tables->bills[i].totalAmount;
+        doctorFees += tables->bills[i].doctorFee;
+    }
+    printf("\n--- Revenue Totals ---\n");
+    printf(" Bills         : %d\n", tables->billCount);
+    printf(" Doctor Fees   : %.2f\n", doctorFees);
+    printf(" Total Revenue : %.2f\n", total);
+    free(tables);
+}
+
+// --- Batch Statement Generation ---
+// Writes a statement (every invoice for the patient plus a total) for all patients.
+// Lookups are prepared once up front, then patients are split across worker threads,
+// each formatting into its own buffer. Output depends only on the data and the shard
+// count, never on the worker count, so a 1-worker run produces the same bytes.
+
+#define STATEMENT_PER_PATIENT 1
+#define STATEMENT_PER_SHARD 2
+
+struct StatementJob {
+    struct AppState* state;
+    char outputDir[PATH_LEN]; // Inside the branch's data directory
+    int mode;
+    int shardCount;
+
+    // Bills grouped by patient: bills of patients[i] are billOrder[billStart[i] .. billStart[i+1]-1]
+    int billStart[MAX_PATIENTS + 1];
+    int billOrder[MAX_BILLS];
+    char* billDoctorName[MAX_BILLS];
+    int orphanBills; // Bills whose patient no longer exists
+
+    struct TextBuffer buffers[MAX_WORKERS]; // One formatting buffer per worker
+    int failures[MAX_WORKERS];
+    int filesWritten[MAX_WORKERS];
+};
+
+// Group bills by patient and resolve doctor names once, in the original bill order
+void prepareStatementJob(struct StatementJob* job) {
+    struct AppState* state = job->state;
+    struct IdSlot patientSlots[MAX_PATIENTS];
+    struct IdSlot doctorSlots[MAX_DOCTORS];
+    int billPatient[MAX_BILLS];
+    int fill[MAX_PATIENTS];
+
+    for (int i = 0; i < state->patientCount; i++) {
+        patientSlots[i].id = state->patients[i].id;
+        patientSlots[i].index = i;
+    }
+    qsort(patientSlots, state->patientCount, sizeof(struct IdSlot), compareIdSlots);
+    for (int i = 0; i < state->doctorCount; i++) {
+        doctorSlots[i].id = state->doctors[i].id;
+        doctorSlots[i].index = i;
+    }
+    qsort(doctorSlots, state->doctorCount, sizeof(struct IdSlot), compareIdSlots);
+
+    // Counting sort keeps each patient's bills in their original order
+    memset(job->billStart, 0, sizeof(job->billStart));
+    job->orphanBills = 0;
+    for (int b = 0; b < state->billCount; b++) {
+        billPatient[b] = lookupIdSlot(patientSlots, state->patientCount, state->bills[b].patientId);
+        if (billPatient[b] == -1) {
+            job->orphanBills++;
+        } else {
+            job->billStart[billPatient[b] + 1]++;
+        }
+
+        job->billDoctorName[b] = "N/A";
+        if (state->bills[b].doctorId != -1) {
+            int doctorIndex = lookupIdSlot(doctorSlots, state->doctorCount, state->bills[b].doctorId);
+            job->billDoctorName[b] = (doctorIndex != -1) ? state->doctors[doctorIndex].name : "Unknown Doctor";
+        }
+    }
+    for (int i = 0; i < state->patientCount; i++) {
+        job->billStart[i + 1] += job->billStart[i];
+        fill[i] = job->billStart[i];
+    }
+    for (int b = 0; b < state->billCount; b++) {
+        if (billPatient[b] != -1) {
+            job->billOrder[fill[billPatient[b]]++] = b;
+        }
+    }
+}
+
+// Append the statement for patients[patientIndex] to buf
+int formatStatement(struct StatementJob* job, int patientIndex, struct TextBuffer* buf) {
+    struct AppState* state = job->state;
+    struct Patient* p = &state->patients[patientIndex];
+    float statementTotal = 0;
+    int rc = 0;
+
+    rc |= appendText(buf, "========================================\n");
+    rc |= appendText(buf, " PATIENT STATEMENT\n");
+    rc |= appendText(buf, " Patient ID    : %d\n", p->id);
+    rc |= appendText(buf, " Name          : %s\n", p->name);
+    rc |= appendText(buf, "========================================\n");
+    for (int k = job->billStart[patientIndex]; k < job->billStart[patientIndex + 1]; k++) {
+        int b = job->billOrder[k];
+        rc |= formatInvoice(buf, &state->bills[b], p, job->billDoctorName[b]);
+        statementTotal += state->bills[b].totalAmount;
+    }
+    if (job->billStart[patientIndex] == job->billStart[patientIndex + 1]) {
+        rc |= appendText(buf, " No bills on record.\n");
+    }
+    rc |= appendText(buf, " Bills         : %d\n", job->billStart[patientIndex + 1] - job->billStart[patientIndex]);
+    rc |= appendText(buf, " Statement Total: %.2f\n", statementTotal);
+    rc |= appendText(buf, "========================================\n\n");
+    return rc;
+}
+
+// Worker task: one patient (per-patient mode) or one shard of patients (shard mode)
+void statementTask(void* context, int taskIndex, int workerIndex) {
+    struct StatementJob* job = (struct StatementJob*)context;
+    struct TextBuffer* buf = &job->buffers[workerIndex];
+    char path[PATH_LEN];
+    int first, last, pathLength;
+
+    if (job->mode == STATEMENT_PER_PATIENT) {
+        first = taskIndex;
+        last = taskIndex + 1;
+        pathLength = snprintf(path, sizeof(path), "%s/patient_%d.txt", job->outputDir,
+                              job->state->patients[taskIndex].id);
+    } else {
+        // Contiguous, deterministic split of the patient table
+        first = (int)((long long)taskIndex * job->state->patientCount / job->shardCount);
+        last = (int)((long long)(taskIndex + 1) * job->state->patientCount / job->shardCount);
+        pathLength = snprintf(path, sizeof(path), "%s/shard_%03d.txt", job->outputDir, taskIndex);
+    }
+    if (pathLength >= (int)sizeof(path)) { // Counted as a failed file
+        job->failures[workerIndex]++;
+        return;
+    }
+
+    buf->length = 0; // Reuse the worker's buffer
+    if (appendText(buf, "") != 0) { // Make sure data is allocated even for empty shards
+        job->failures[workerIndex]++;
+        return;
+    }
+    for (int i = first; i < last; i++) {
+        if (formatStatement(job, i, buf) != 0) {
+            job->failures[workerIndex]++;
+            return;
+        }
+    }
+    if (writeTextFile(path, buf) != 0) {
+        job->failures[workerIndex]++;
+    } else {
+        job->filesWritten[workerIndex]++;
+    }
+}
+
+// Generate statements for every patient. Returns the number of failed files.
+int generateStatements(struct AppState* state, int mode, int shardCount, int workerCount) {
+    struct StatementJob* job = malloc(sizeof(struct StatementJob));
+    if (job == NULL) {
+        printf("Error: Not enough memory for statement generation.\n");
+        return -1;
+    }
+    job->state = state;
+    job->mode = mode;
+    job->shardCount = shardCount;
+    for (int w = 0; w < MAX_WORKERS; w++) {
+        initTextBuffer(&job->buffers[w]);
+        job->failures[w] = 0;
+        job->filesWritten[w] = 0;
+    }
+
+    double started = currentTimeMillis();
+    prepareStatementJob(job);
+    buildDataPath(state, STATEMENT_DIR, job->outputDir);
+    makeDirectory(job->outputDir);
+
+    int taskCount = (mode == STATEMENT_PER_PATIENT) ? state->patientCount : shardCount;
+    int used = runWorkerPool(statementTask, job, taskCount, workerCount);
+
+    int failures = 0, files = 0;
+    for (int w = 0; w < MAX_WORKERS; w++) {
+        failures += job->failures[w];
+        files += job->filesWritten[w];
+        freeTextBuffer(&job->buffers[w]);
+    }
+    printf("%d statement file(s) written to '%s/' using %d worker(s) in %.1f ms.\n",
+           files, job->outputDir, used, currentTimeMillis() - started);
+    if (job->orphanBills > 0) {
+        printf("Note: %d bill(s) skipped because their patient no longer exists.\n", job->orphanBills);
+    }
+    if (failures > 0) {
+        printf("Warning: %d statement file(s) could not be written.\n", failures);
+    }
+    free(job);
+    return failures;
+}
+
+void batchStatements(struct AppState* state) {
+    if (state->patientCount == 0) {
+        printf("No patients in the system.\n");
+        return;
+    }
+    printf("--- Generate Patient Statements ---\n");
+    int mode = getIntInput("Output (1 = one file per patient, 2 = sharded files): ");
+    if (mode != STATEMENT_PER_PATIENT && mode != STATEMENT_PER_SHARD) {
+        printf("Invalid choice.\n");
+        return;
+    }
+    int shardCount = 1;
+    if (mode == STATEMENT_PER_SHARD) {
+        shardCount = getIntInput("Number of shard files: ");
+        if (shardCount < 1) {
+            printf("Shard count must be at least 1.\n");
+            return;
+        }
+    }
+    int workerCount = getIntInput("Worker threads (0 = one per core): ");
+    if (workerCount <= 0) workerCount = getCoreCount();
+
+    generateStatements(state, mode, shardCount, workerCount);
+}
+
+
+// --- Branches (Data Partitions) ---
+// One process manages several hospital branches. Each branch has its own tables,
+// counters and data directory. IDs are globally unique: branch b hands out IDs
+// b * BRANCH_ID_STRIDE + 1, + 2, ..., so the owning branch of any ID is known
+// without searching. Branch 0 keeps IDs from 1, so existing data is unchanged.
+
+struct Hospital {
+    struct AppState* branches[MAX_BRANCHES];
+    int branchCount;
+    int current; // Index of the branch the menus work on
+    int ioFlags; // Table I/O options given on the command line
+    struct CdcStream* cdc; // Change event stream shared by all branches
+};
+
+int branchOfId(int id) {
+    return id / BRANCH_ID_STRIDE;
+}
+
+struct AppState* createBranchState(int branchId, char* name, char* dataDir) {
+    struct AppState* state = calloc(1, sizeof(struct AppState));
+    if (state == NULL) return NULL;
+    state->branchId = branchId;
+    snprintf(state->branchName, NAME_LEN, "%s", name);
+    snprintf(state->dataDir, PATH_LEN, "%s", dataDir);
+    return state;
+}
+
+// Branch owning an ID (any record type), or NULL if no such branch exists
+struct AppState* findBranchForId(struct Hospital* hospital, int id) {
+    int branchId = branchOfId(id);
+    for (int b = 0; b < hospital->branchCount; b++) {
+        if (hospital->branches[b]->branchId == branchId) {
+            return hospital->branches[b];
+        }
+    }
+    return NULL;
+}
+
+// Written aside and renamed over the old list, so a failed write keeps it
+void saveBranchConfig(struct Hospital* hospital) {
+    char tempPath[PATH_LEN];
+    snprintf(tempPath, sizeof(tempPath), "%s.tmp", BRANCH_FILE);
+    FILE *fp = fopen(tempPath, "w");
+    if (fp == NULL) {
+        perror("Error opening branch file for writing");
+        return;
+    }
+    for (int b = 0; b < hospital->branchCount; b++) {
+        struct AppState* state = hospital->branches[b];
+        fprintf(fp, "%d|%s|%s\n", state->branchId, state->branchName, state->dataDir);
+    }
+    int failed = ferror(fp);
+    if (fclose(fp) != 0 || failed) {
+        perror("Error writing branch file");
+        remove(tempPath);
+        return;
+    }
+    if (replaceFile(tempPath, BRANCH_FILE) != 0) {
+        perror("Error replacing branch file");
+    }
+}
+
+// Read the branch list. Without a branch file there is one branch using the
+// current directory, exactly as before branches existed. Returns -1 on failure.
+int loadBranchConfig(struct Hospital* hospital) {
+    char line[NAME_LEN + PATH_LEN + 32];
+    hospital->branchCount = 0;
+    hospital->current = 0;
+
+    FILE *fp = fopen(BRANCH_FILE, "r");
+    if (fp != NULL) {
+        while (fgets(line, sizeof(line), fp) != NULL && hospital->branchCount < MAX_BRANCHES) {
+            int branchId;
+            char name[NAME_LEN];
+            char dataDir[PATH_LEN];
+            if (sscanf(line, "%d|%99[^|]|%259[^\r\n]", &branchId, name, dataDir) != 3) continue;
+            if (branchId < 0 || branchId >= 2147483647 / BRANCH_ID_STRIDE) {
+                printf("Warning: Branch ID %d out of range, skipped.\n", branchId);
+                continue;
+            }
+            if (findBranchForId(hospital, branchId * BRANCH_ID_STRIDE) != NULL) {
+                printf("Warning: Duplicate branch ID %d, skipped.\n", branchId);
+                continue;
+            }
+            struct AppState* state = createBranchState(branchId, name, dataDir);
+            if (state == NULL) break;
+            state->ioFlags = hospital->ioFlags;
+            hospital->branches[hospital->branchCount++] = state;
+        }
+        fclose(fp);
+    }
+    if (hospital->branchCount == 0) {
+        struct AppState* state = createBranchState(0, "Main", ".");
+        if (state == NULL) return -1;
+        state->ioFlags = hospital->ioFlags;
+        hospital->branches[hospital->branchCount++] = state;
+    }
+    return 0;
+}
+
+void freeBranches(struct Hospital* hospital) {
+    for (int b = 0; b < hospital->branchCount; b++) {
+        closeChangeLog(hospital->branches[b]);
+        closeTriageLog(hospital->branches[b]);
+        freeVersionStores(hospital->branches[b]);
+        free(hospital->branches[b]);
+    }
+    hospital->branchCount = 0;
+}
+
+struct SaveResults {
+    struct Hospital* hospital;
+    int failed[MAX_BRANCHES];
+};
+
+void loadBranchTask(void* context, int taskIndex, int workerIndex) {
+    struct Hospital* hospital = (struct Hospital*)context;
+    (void)workerIndex;
+    loadData(hospital->branches[taskIndex]);
+    openChangeLog(hospital->branches[taskIndex]);
+}
+
+void saveBranchTask(void* context, int taskIndex, int workerIndex) {
+    struct SaveResults* results = (struct SaveResults*)context;
+    (void)workerIndex;
+    results->failed[taskIndex] = saveData(results->hospital->branches[taskIndex]) != 0;
+}
+
+// Branches share nothing, so they load and save in parallel
+void loadAllBranches(struct Hospital* hospital) {
+    runWorkerPool(loadBranchTask, hospital, hospital->branchCount, getCoreCount());
+}
+
+void saveAllBranches(struct Hospital* hospital) {
+    struct SaveResults results;
+    results.hospital = hospital;
+    runWorkerPool(saveBranchTask, &results, hospital->branchCount, getCoreCount());
+
+    int failures = 0;
+    for (int b = 0; b < hospital->branchCount; b++) {
+        if (results.failed[b]) {
+            printf("Warning: Data for branch '%s' could not be saved.\n", hospital->branches[b]->branchName);
+            failures++;
+        }
+    }
+    if (failures == 0) {
+        printf("Data saved successfully.\n");
+    }
+}
+
+void listBranches(struct Hospital* hospital) {
+    printf("\n--- Branches (%d) ---\n", hospital->branchCount);
+    printf("-------------------------------------------------------------------------------------\n");
+    printf("    | Branch ID | Name                 | Patients | Doctors | Appts | Bills | Data Directory\n");
+    printf("-------------------------------------------------------------------------------------\n");
+    for (int b = 0; b < hospital->branchCount; b++) {
+        struct AppState* state = hospital->branches[b];
+        printf("%-3s | %-9d | %-20s | %-8d | %-7d | %-5d | %-5d | %s\n",
+               b == hospital->current ? "*" : "", state->branchId, state->branchName,
+               state->patientCount, state->doctorCount, state->appointmentCount, state->billCount,
+               state->dataDir);
+    }
+    printf("-------------------------------------------------------------------------------------\n");
+}
+
+void switchBranch(struct Hospital* hospital) {
+    listBranches(hospital);
+    int branchId = getIntInput("Enter Branch ID to work on: ");
+    for (int b = 0; b < hospital->branchCount; b++) {
+        if (hospital->branches[b]->branchId == branchId) {
+            hospital->current = b;
+            printf("Now working on branch '%s'.\n", hospital->branches[b]->branchName);
+            return;
+        }
+    }
+    printf("Branch with ID %d not found.\n", branchId);
+}
+
+void addBranch(struct Hospital* hospital) {
+    if (hospital->branchCount >= MAX_BRANCHES) {
+        printf("Maximum branch limit reached.\n");
+        return;
+    }
+    char name[NAME_LEN];
+    char dataDir[PATH_LEN];
+    int branchId = 0;
+    for (int b = 0; b < hospital->branchCount; b++) {
+        if (hospital->branches[b]->branchId >= branchId) branchId = hospital->branches[b]->branchId + 1;
+    }
+
+    printf("--- Add New Branch ---\n");
+    getStringInput("Enter Branch Name: ", name, NAME_LEN);
+    getStringInput("Enter Data Directory (e.g., branch_north): ", dataDir, PATH_LEN);
+    if (name[0] == '\0' || dataDir[0] == '\0' || strchr(name, '|') != NULL) {
+        printf("Branch name and directory are required ('|' is not allowed).\n");
+        return;
+    }
+    for (int b = 0; b < hospital->branchCount; b++) {
+        if (strcmp(hospital->branches[b]->dataDir, dataDir) == 0) {
+            printf("Branch '%s' already uses that directory.\n", hospital->branches[b]->branchName);
+            return;
+        }
+    }
+
+    struct AppState* state = createBranchState(branchId, name, dataDir);
+    if (state == NULL) {
+        printf("Error: Not enough memory for a new branch.\n");
+        return;
+    }
+    state->ioFlags = hospital->ioFlags;
+    makeDirectory(dataDir);
+    loadData(state); // Picks up existing files, otherwise starts empty in its ID range
+    openChangeLog(state);
+    state->cdc = hospital->cdc;
+    hospital->branches[hospital->branchCount++] = state;
+    saveBranchConfig(hospital);
+    printf("Branch '%s' added with ID %d (record IDs start at %d).\n",
+           name, branchId, branchId * BRANCH_ID_STRIDE + 1);
+}
+
+// Route an ID straight to its branch and print the record
+void lookupRecordAnyBranch(struct Hospital* hospital) {
+    printf("Record type (1 = Patient, 2 = Doctor, 3 = Appointment, 4 = Bill): ");
+    int type = getIntInput("");
+    int id = getIntInput("Enter ID: ");
+    struct AppState* state = findBranchForId(hospital, id);
+    if (state == NULL) {
+        printf("No branch owns ID %d.\n", id);
+        return;
+    }
+
+    int index = -1;
+    switch (type) {
+        case 1:
+            index = findPatientById(state, id);
+            if (index != -1) {
+                struct Patient* p = &state->patients[index];
+                printf("[%s] Patient %d: %s, Age %d, %s, %s, Contact %s\n", state->branchName,
+                       p->id, p->name, p->age, p->gender, p->disease, p->contact);
+            }
+            break;
+        case 2:
+            index = findDoctorById(state, id);
+            if (index != -1) {
+                struct Doctor* d = &state->doctors[index];
+                printf("[%s] Doctor %d: %s, %s, %s\n", state->branchName,
+                       d->id, d->name, d->specialization, d->availability);
+            }
+            break;
+        case 3: {
+            struct Appointment archived;
+            struct Appointment* a = NULL;
+            index = findAppointmentById(state, id);
+            if (index != -1) a = &state->appointments[index];
+            else if (findArchivedAppointment(state, id, &archived) == 0) a = &archived; // Slower cold path
+            if (a != NULL) {
+                printf("[%s] Appointment %d: Patient %s with Dr. %s on %s at %s%s\n", state->branchName,
+                       a->id, getPatientNameById(state, a->patientId),
+                       getDoctorNameById(state, a->doctorId), a->date, a->time,
+                       index == -1 ? " (archived)" : "");
+                index = 0;
+            }
+            break;
+        }
+        case 4: {
+            struct Bill archived;
+            struct Bill* bill = NULL;
+            index = findBillById(state, id);
+            if (index != -1) bill = &state->bills[index];
+            else if (findArchivedBill(state, id, &archived) == 0) bill = &archived;
+            if (bill != NULL) {
+                printf("[%s] Bill %d: Patient %s, Total %.2f, Date %s%s\n", state->branchName,
+                       bill->id, getPatientNameById(state, bill->patientId),
+                       bill->totalAmount, bill->dateGenerated, index == -1 ? " (archived)" : "");
+                index = 0;
+            }
+            break;
+        }
+        default:
+            printf("Invalid record type.\n");
+            return;
+    }
+    if (index == -1) {
+        printf("ID %d not found in branch '%s'.\n", id, state->branchName);
+    }
+}
+
+// --- Cross-Branch Queries ---
+// Each branch is queried by its own worker; results are merged afterwards.
+
+#define QUERY_PATIENT_NAME 1
+#define QUERY_APPOINTMENT_DATE 2
+#define QUERY_REVENUE 3
+
+struct BranchQuery {
+    struct Hospital* hospital;
+    int type;
+    char text[NAME_LEN];
+    int matches[MAX_BRANCHES][MAX_APPOINTMENTS > MAX_PATIENTS ? MAX_APPOINTMENTS : MAX_PATIENTS];
+    int matchCount[MAX_BRANCHES];
+    double revenue[MAX_BRANCHES];
+};
+
+void branchQueryTask(void* context, int taskIndex, int workerIndex) {
+    struct BranchQuery* query = (struct BranchQuery*)context;
+    struct AppState* state = query->hospital->branches[taskIndex];
+    int count = 0;
+    (void)workerIndex;
+
+    if (query->type == QUERY_PATIENT_NAME) {
+        for (int i = 0; i < state->patientCount; i++) {
+            if (strstr(state->patients[i].name, query->text) != NULL) {
+                query->matches[taskIndex][count++] = i;
+            }
+        }
+    } else if (query->type == QUERY_APPOINTMENT_DATE) {
+        for (int i = 0; i < state->appointmentCount; i++) {
+            if (strcmp(state->appointments[i].date, query->text) == 0) {
+                query->matches[taskIndex][count++] = i;
+            }
+        }
+    } else if (query->type == QUERY_REVENUE) {
+        double total = 0;
+        for (int i = 0; i < state->billCount; i++) {
+            total += state->bills[i].totalAmount;
+        }
+        query->revenue[taskIndex] = total;
+        count = state->billCount;
+    }
+    query->matchCount[taskIndex] = count;
+}
+
+struct BranchQuery* runBranchQuery(struct Hospital* hospital, int type, char* text) {
+    struct BranchQuery* query = malloc(sizeof(struct BranchQuery));
+    if (query == NULL) {
+        printf("Error: Not enough memory for the query.\n");
+        return NULL;
+    }
+    query->hospital = hospital;
+    query->type = type;
+    snprintf(query->text, NAME_LEN, "%s", text);
+    runWorkerPool(branchQueryTask, query, hospital->branchCount, getCoreCount());
+    return query;
+}
+
+void searchPatientsAllBranches(struct Hospital* hospital) {
+    char name[NAME_LEN];
+    getStringInput("Enter Patient Name (or part of it): ", name, NAME_LEN);
+    struct BranchQuery* query = runBranchQuery(hospital, QUERY_PATIENT_NAME, name);
+    if (query == NULL) return;
+
+    // Branch results are each in ID order and branches own disjoint ID ranges,
+    // so listing branches in ID order gives one merged, ID-ordered list
+    int order[MAX_BRANCHES];
+    for (int b = 0; b < hospital->branchCount; b++) order[b] = b;
+    for (int i = 1; i < hospital->branchCount; i++) {
+        int key = order[i], j = i - 1;
+        while (j >= 0 && hospital->branches[order[j]]->branchId > hospital->branches[key]->branchId) {
+            order[j + 1] = order[j];
+            j--;
+        }
+        order[j + 1] = key;
+    }
+
+    int total = 0;
+    printf("-----------------------------------------------------------------------------------\n");
+    printf("ID        | Name                 | Age | Contact        | Branch\n");
+    printf("-----------------------------------------------------------------------------------\n");
+    for (int k = 0; k < hospital->branchCount; k++) {
+        int b = order[k];
+        struct AppState* state = hospital->branches[b];
+        for (int m = 0; m < query->matchCount[b]; m++) {
+            struct Patient* p = &state->patients[query->matches[b][m]];
+            printf("%-9d | %-20s | %-3d | %-14s | %s\n", p->id, p->name, p->age, p->contact, state->branchName);
+            total++;
+        }
+    }
+    printf("-----------------------------------------------------------------------------------\n");
+    printf("%d patient(s) found across %d branch(es).\n", total, hospital->branchCount);
+    free(query);
+}
+
+struct MergedAppointment {
+    struct AppState* state;
+    struct Appointment* appt;
+};
+
+int compareMergedAppointments(const void* a, const void* b) {
+    const struct MergedAppointment* x = (const struct MergedAppointment*)a;
+    const struct MergedAppointment* y = (const struct MergedAppointment*)b;
+    int byTime = strcmp(x->appt->time, y->appt->time);
+    if (byTime != 0) return byTime;
+    return (x->appt->id > y->appt->id) - (x->appt->id < y->appt->id);
+}
+
+void appointmentsOnDateAllBranches(struct Hospital* hospital) {
+    char date[DATE_LEN];
+    getStringInput("Enter Date (YYYY-MM-DD): ", date, DATE_LEN);
+    struct BranchQuery* query = runBranchQuery(hospital, QUERY_APPOINTMENT_DATE, date);
+    if (query == NULL) return;
+
+    int total = 0;
+    for (int b = 0; b < hospital->branchCount; b++) total += query->matchCount[b];
+    struct MergedAppointment* merged = malloc((total > 0 ? total : 1) * sizeof(struct MergedAppointment));
+    if (merged == NULL) {
+        printf("Error: Not enough memory for the query.\n");
+        free(query);
+        return;
+    }
+    int n = 0;
+    for (int b = 0; b < hospital->branchCount; b++) {
+        for (int m = 0; m < query->matchCount[b]; m++) {
+            merged[n].state = hospital->branches[b];
+            merged[n].appt = &hospital->branches[b]->appointments[query->matches[b][m]];
+            n++;
+        }
+    }
+    qsort(merged, n, sizeof(struct MergedAppointment), compareMergedAppointments);
+
+    printf("\n--- Appointments on %s, all branches (%d) ---\n", date, n);
+    printf("-------------------------------------------------------------------------------------------\n");
+    printf("Time  | Appt ID   | Patient Name       | Doctor Name        | Branch\n");
+    printf("-------------------------------------------------------------------------------------------\n");
+    for (int i = 0; i < n; i++) {
+        struct AppState* state = merged[i].state;
+        struct Appointment* a = merged[i].appt;
+        printf("%-5s | %-9d | %-18s | %-18s | %s\n", a->time, a->id,
+               getPatientNameById(state, a->patientId), getDoctorNameById(state, a->doctorId),
+               state->branchName);
+    }
+    printf("-------------------------------------------------------------------------------------------\n");
+    free(merged);
+    free(query);
+}
+
+void revenueAllBranches(struct Hospital* hospital) {
+    struct BranchQuery* query = runBranchQuery(hospital, QUERY_REVENUE, "");
+    if (query == NULL) return;
+
+    double grandTotal = 0;
+    int bills = 0;
+    printf("\n--- Revenue by Branch ---\n");
+    printf("------------------------------------------------------\n");
+    printf("Branch               | Bills  | Revenue\n");
+    printf("------------------------------------------------------\n");
+    for (int b = 0; b < hospital->branchCount; b++) {
+        printf("%-20s | %-6d | %.2f\n", hospital->branches[b]->branchName, query->matchCount[b], query->revenue[b]);
+        grandTotal += query->revenue[b];
+        bills += query->matchCount[b];
+    }
+    printf("------------------------------------------------------\n");
+    printf("%-20s | %-6d | %.2f\n", "All Branches", bills, grandTotal);
+    free(query);
+}
+
+// --- Read Replica ---
+// Started with: hospital_management --replica <data directory> [max staleness in ms]
+// Follows the primary's change log in that directory and serves read-only
+// reports from its own copy of the tables. Before each report the replica
+// applies new log records unless it already did so within the staleness bound,
+// so answers are never older than that bound (default 0: always up to date).
+// On restart it simply replays the log to catch up.
+
+struct ReplicaState {
+    struct AppState* state;
+    char logPath[PATH_LEN];
+    long offset;              // Bytes of the current log generation applied so far
+    long long generation;     // Generation being followed (0 = none yet)
+    long long lastChangeTime; // Timestamp of the last applied change
+    double lastPollMillis;
+    int maxStalenessMs;
+};
+
+void clearReplicaTables(struct AppState* state) {
+    state->patientCount = 0;
+    state->doctorCount = 0;
+    state->appointmentCount = 0;
+    state->billCount = 0;
+    state->lastLsn = 0;
+    state->history.versionCount = 0; // Replaying the log records the history again
+    state->history.dataUsed = 0;
+    rebuildHistoryHeads(&state->history);
+    rebuildSlotCalendar(state, todayDayNumber(NULL));
+    rebuildDashboard(state);
+    rebuildDateIndex(state);
+    rebuildNameIndex(state); // Drop names of patients from the old generation
+    resetVersionStores(state);
+}
+
+void applyChangeRecord(struct AppState* state, struct ChangeRecord* record) {
+    int index;
+    switch (record->table) {
+        case TABLE_PATIENT:
+            index = findPatientById(state, record->recordId);
+            if (record->op == OP_DELETE) {
+                if (index != -1) removePatientAt(state, index);
+            } else if (index != -1) {
+                updatePatientRecord(state, index, &record->data.patient);
+            } else if (state->patientCount < MAX_PATIENTS) {
+                insertPatientRecord(state, &record->data.patient);
+            }
+            break;
+        case TABLE_DOCTOR:
+            index = findDoctorById(state, record->recordId);
+            if (index != -1) {
+                state->doctors[index] = record->data.doctor;
+            } else if (state->doctorCount < MAX_DOCTORS) {
+                insertDoctorRecord(state, &record->data.doctor, NULL);
+            }
+            break;
+        case TABLE_HOURS:
+            index = findDoctorById(state, record->recordId);
+            if (index != -1) updateDoctorHours(state, index, &record->data.hours);
+            break;
+        case TABLE_APPOINTMENT:
+            index = findAppointmentById(state, record->recordId);
+            if (record->op == OP_DELETE) {
+                if (index != -1) removeAppointmentAt(state, index);
+            } else if (index != -1) {
+                updateAppointmentRecord(state, index, &record->data.appointment);
+            } else if (state->appointmentCount < MAX_APPOINTMENTS) {
+                insertAppointmentRecord(state, &record->data.appointment);
+            }
+            break;
+        case TABLE_BILL:
+            index = findBillById(state, record->recordId);
+            if (record->op == OP_DELETE) {
+                if (index != -1) removeBillAt(state, index);
+            } else if (index != -1) {
+                updateBillRecord(state, index, &record->data.bill);
+            } else if (state->billCount < MAX_BILLS) {
+                insertBillRecord(state, &record->data.bill);
+            }
+            break;
+    }
+    state->nextPatientId = record->nextIds[0];
+    state->nextDoctorId = record->nextIds[1];
+    state->nextAppointmentId = record->nextIds[2];
+    state->nextBillId = record->nextIds[3];
+    state->lastLsn = record->lsn;
+}
+
+// Apply every complete record added since the last poll.
+// Returns the number applied, or -1 if the log cannot be opened.
+int pollChangeLog(struct ReplicaState* replica) {
+    struct ChangeRecord record;
+    int applied = 0;
+
+    FILE* fp = fopen(replica->logPath, "rb");
+    if (fp == NULL) return -1;
+    replica->lastPollMillis = currentTimeMillis();
+
+    if (fread(&record, sizeof(record), 1, fp) != 1 || !isValidChangeRecord(&record)
+        || record.table != TABLE_LOG_HEADER) {
+        fclose(fp);
+        return 0; // Primary has not written a header yet
+    }
+    if (record.generation != replica->generation) {
+        // New log generation: rebuild from its full image
+        clearReplicaTables(replica->state);
+        replica->generation = record.generation;
+        replica->offset = 0;
+    }
+
+    fseek(fp, replica->offset, SEEK_SET);
+    while (fread(&record, sizeof(record), 1, fp) == 1) {
+        if (!isValidChangeRecord(&record)) break; // Torn record still being written
+        applyChangeRecord(replica->state, &record);
+        replica->offset += sizeof(record);
+        replica->lastChangeTime = record.timestamp;
+        applied++;
+    }
+    fclose(fp);
+    return applied;
+}
+
+// Changes present in the log but not applied yet, and the age of the oldest one
+void measureReplicaLag(struct ReplicaState* replica, long* pending, long long* lagSeconds) {
+    struct ChangeRecord record;
+    *pending = 0;
+    *lagSeconds = 0;
+    FILE* fp = fopen(replica->logPath, "rb");
+    if (fp == NULL) return;
+    if (fread(&record, sizeof(record), 1, fp) == 1 && record.generation != replica->generation) {
+        replica->offset = 0; // Whole new generation is pending
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    if (size > replica->offset) {
+        *pending = (size - replica->offset) / (long)sizeof(record);
+        fseek(fp, replica->offset, SEEK_SET);
+        if (*pending > 0 && fread(&record, sizeof(record), 1, fp) == 1 && isValidChangeRecord(&record)) {
+            *lagSeconds = (long long)time(NULL) - record.timestamp;
+        }
+    }
+    fclose(fp);
+}
+
+// Catch up if the last poll is older than the staleness bound
+void refreshReplica(struct ReplicaState* replica) {
+    if (currentTimeMillis() - replica->lastPollMillis >= replica->maxStalenessMs) {
+        if (pollChangeLog(replica) < 0) {
+            printf("Warning: Change log '%s' not found; showing last known data.\n", replica->logPath);
+        }
+    }
+}
+
+void replicationStatus(struct ReplicaState* replica) {
+    long pending;
+    long long lagSeconds;
+    measureReplicaLag(replica, &pending, &lagSeconds);
+
+    printf("\n--- Replication Status ---\n");
+    printf(" Change log        : %s\n", replica->logPath);
+    printf(" Applied LSN       : %lld\n", replica->state->lastLsn);
+    printf(" Pending changes   : %ld\n", pending);
+    printf(" Lag               : %lld s\n", pending > 0 ? lagSeconds : 0LL);
+    printf(" Last poll         : %.0f ms ago\n", currentTimeMillis() - replica->lastPollMillis);
+    printf(" Staleness bound   : %d ms\n", replica->maxStalenessMs);
+    if (replica->lastChangeTime > 0) {
+        time_t changed = (time_t)replica->lastChangeTime;
+        printf(" Last change made  : %s", ctime(&changed));
+    }
+}
+
+int runReplica(char* dataDir, int maxStalenessMs) {
+    struct ReplicaState replica;
+    struct AppState* state = createBranchState(0, "Replica", dataDir);
+    if (state == NULL) {
+        printf("Error: Not enough memory to start.\n");
+        return 1;
+    }
+    memset(&replica, 0, sizeof(replica));
+    replica.state = state;
+    replica.maxStalenessMs = maxStalenessMs < 0 ? 0 : maxStalenessMs;
+    buildDataPath(state, CHANGE_LOG_FILE, replica.logPath);
+    clearReplicaTables(state);
+
+    // Catch up with everything logged so far
+    double started = currentTimeMillis();
+    int applied = pollChangeLog(&replica);
+    if (applied < 0) {
+        printf("Warning: No change log at '%s' yet; waiting for the primary.\n", replica.logPath);
+    } else {
+        printf("Caught up: applied %d change(s) up to LSN %lld in %.1f ms.\n",
+               applied, state->lastLsn, currentTimeMillis() - started);
+    }
+
+    int choice;
+    while (1) {
+        printf("\n===== Hospital Management System (Read Replica) =====\n");
+        printf("1. View All Appointments\n");
+        printf("2. View All Bills\n");
+        printf("3. Revenue Totals\n");
+        printf("4. View All Patients\n");
+        printf("5. Replication Status\n");
+        printf("0. Exit\n");
+        printf("======================================\n");
+        choice = getIntInput("Enter your choice: ");
+
+        if (choice >= 1 && choice <= 4) refreshReplica(&replica);
+        switch (choice) {
+            case 1: viewAppointments(state); break;
+            case 2: viewBills(state); break;
+            case 3: viewRevenueTotals(state); break;
+            case 4: viewPatients(state); break;
+            case 5: replicationStatus(&replica); break;
+            case 0:
+            case -1: // End of input
+                freeVersionStores(state);
+                free(state);
+                printf("Goodbye!\n");
+                return 0;
+            default:
+                printf("Invalid choice. Please try again.\n");
+        }
+    }
+}
+
+// --- Menu Functions (Now require AppState pointer) ---
 
 void patientMenu(struct AppState* state) {
     int choice;
@@ -831,6 +6601,10 @@ void patientMenu(struct AppState* state) {
         printf("2. View All Patients\n");
         printf("3. Edit Patient Information\n");
         printf("4. Delete Patient Record\n");
+        printf("5. View Patient Edit History\n");
+        printf("6. View Patient As Of a Date\n");
+        printf("7. Trim Old Patient History\n");
+        printf("8. Search Patient by Name\n");
         printf("0. Back to Main Menu\n");
         choice = getIntInput("Enter your choice: ");
 
@@ -839,6 +6613,10 @@ void patientMenu(struct AppState* state) {
             case 2: viewPatients(state); break;
             case 3: editPatient(state); break;
             case 4: deletePatient(state); break;
+            case 5: viewPatientHistory(state); break;
+            case 6: viewPatientAsOf(state); break;
+            case 7: trimHistoryMenu(state); break;
+            case 8: searchPatientByName(state); break;
             case 0: return;
             default: printf("Invalid choice. Please try again.\n");
         }
@@ -852,6 +6630,7 @@ void doctorMenu(struct AppState* state) {
         printf("1. Add New Doctor\n");
         printf("2. View All Doctors\n");
         printf("3. Search Doctor (by Name/Specialization)\n");
+        printf("4. Set Doctor Working Hours\n");
         printf("0. Back to Main Menu\n");
         choice = getIntInput("Enter your choice: ");
 
@@ -859,6 +6638,7 @@ void doctorMenu(struct AppState* state) {
             case 1: addDoctor(state); break;
             case 2: viewDoctors(state); break;
             case 3: searchDoctor(state); break;
+            case 4: editDoctorHours(state); break;
             case 0: return;
             default: printf("Invalid choice. Please try again.\n");
         }
@@ -872,6 +6652,9 @@ void appointmentMenu(struct AppState* state) {
         printf("1. Schedule New Appointment\n");
         printf("2. View All Appointments\n");
         printf("3. Cancel Appointment\n");
+        printf("4. Find Next Available Slots\n");
+        printf("5. List Appointments by Date\n");
+        printf("6. Schedule Appointment with Bill\n");
         printf("0. Back to Main Menu\n");
         choice = getIntInput("Enter your choice: ");
 
@@ -879,6 +6662,9 @@ void appointmentMenu(struct AppState* state) {
             case 1: scheduleAppointment(state); break;
             case 2: viewAppointments(state); break;
             case 3: cancelAppointment(state); break;
+            case 4: findAvailableSlots(state); break;
+            case 5: listAppointmentsByDate(state); break;
+            case 6: scheduleAppointmentWithBill(state); break;
             case 0: return;
             default: printf("Invalid choice. Please try again.\n");
         }
@@ -892,6 +6678,8 @@ void billingMenu(struct AppState* state) {
         printf("1. Generate New Bill\n");
         printf("2. View All Bills\n");
         printf("3. Print Invoice\n");
+        printf("4. Generate Patient Statements (Batch)\n");
+        printf("5. Revenue Totals\n");
         printf("0. Back to Main Menu\n");
         choice = getIntInput("Enter your choice: ");
 
@@ -899,52 +6687,697 @@ void billingMenu(struct AppState* state) {
             case 1: generateBill(state); break;
             case 2: viewBills(state); break;
             case 3: printInvoice(state); break;
+            case 4: batchStatements(state); break;
+            case 5: viewRevenueTotals(state); break;
             case 0: return;
             default: printf("Invalid choice. Please try again.\n");
         }
     }
 }
 
-// --- Main Function ---
-int main() {
-    // Declare the application state structure
-    struct AppState appState;
+void waitingRoomMenu(struct AppState* state) {
+    int choice;
+    while (1) {
+        printf("\n--- Waiting Room (Walk-ins) ---\n");
+        printf("1. Add Walk-in Patient\n");
+        printf("2. Call Next Patient\n");
+        printf("3. Change Triage Level\n");
+        printf("4. Remove Patient from Waiting Room\n");
+        printf("5. View Waiting Room\n");
+        printf("0. Back to Main Menu\n");
+        choice = getIntInput("Enter your choice: ");
+
+        switch (choice) {
+            case 1: addWalkIn(state); break;
+            case 2: callNextPatient(state); break;
+            case 3: changeTriageLevel(state); break;
+            case 4: removeWalkIn(state); break;
+            case 5: viewWaitingRoom(state); break;
+            case 0: return;
+            default: printf("Invalid choice. Please try again.\n");
+        }
+    }
+}
+
+void archiveMenu(struct AppState* state) {
+    int choice;
+    while (1) {
+        printf("\n--- Archive (Old Records) ---\n");
+        printf("1. Archive Old Appointments and Bills\n");
+        printf("2. Find Archived Record by ID\n");
+        printf("3. Archived Records of a Patient\n");
+        printf("4. List Archive Segments\n");
+        printf("0. Back to Main Menu\n");
+        choice = getIntInput("Enter your choice: ");
+
+        switch (choice) {
+            case 1: archiveOldRecordsMenu(state); break;
+            case 2: findArchivedRecordMenu(state); break;
+            case 3: patientArchiveMenu(state); break;
+            case 4: listArchiveSegments(state); break;
+            case 0: return;
+            default: printf("Invalid choice. Please try again.\n");
+        }
+    }
+}
+
+void dashboardMenu(struct AppState* state) {
+    int choice;
+    while (1) {
+        printf("\n--- Dashboard (Working Tables) ---\n");
+        printf("1. Today's Summary\n");
+        printf("2. Summary for a Date\n");
+        printf("3. Dump Dashboard to File\n");
+        printf("4. Verify Against Full Recount\n");
+        printf("0. Back to Main Menu\n");
+        choice = getIntInput("Enter your choice: ");
+
+        switch (choice) {
+            case 1: viewDashboardToday(state); break;
+            case 2: viewDashboardForDate(state); break;
+            case 3: dumpDashboard(state); break;
+            case 4: verifyDashboard(state); break;
+            case 0: return;
+            default: printf("Invalid choice. Please try again.\n");
+        }
+    }
+}
+
+void branchMenu(struct Hospital* hospital) {
+    int choice;
+    while (1) {
+        printf("\n--- Branch Management ---\n");
+        printf("1. List Branches\n");
+        printf("2. Switch Branch\n");
+        printf("3. Add New Branch\n");
+        printf("4. Look Up Record by ID (any branch)\n");
+        printf("5. Search Patients by Name (all branches)\n");
+        printf("6. Appointments on a Date (all branches)\n");
+        printf("7. Revenue by Branch\n");
+        printf("0. Back to Main Menu\n");
+        choice = getIntInput("Enter your choice: ");
+
+        switch (choice) {
+            case 1: listBranches(hospital); break;
+            case 2: switchBranch(hospital); break;
+            case 3: addBranch(hospital); break;
+            case 4: lookupRecordAnyBranch(hospital); break;
+            case 5: searchPatientsAllBranches(hospital); break;
+            case 6: appointmentsOnDateAllBranches(hospital); break;
+            case 7: revenueAllBranches(hospital); break;
+            case 0: return;
+            default: printf("Invalid choice. Please try again.\n");
+        }
+    }
+}
+
+// --- Self Test ---
+// Started with: hospital_management --self-test
+// Checks the indexes, codecs and logs against simple reference answers, using
+// in-memory tables only (no data files are read or written). Prints one line
+// per check; the exit status is 1 if any check fails.
+
+void selfCheck(int* failures, int ok, char* what) {
+    printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok) (*failures)++;
+}
+
+// An empty branch with every index built, as a replica starts out
+struct AppState* createSelfTestState(void) {
+    struct AppState* state = createBranchState(0, "Self Test", ".");
+    if (state == NULL) return NULL;
+    clearReplicaTables(state);
+    state->nextPatientId = state->nextDoctorId = state->nextAppointmentId = state->nextBillId = 1;
+    return state;
+}
+
+void freeSelfTestState(struct AppState* state) {
+    if (state == NULL) return;
+    freeVersionStores(state);
+    free(state);
+}
+
+void selfTestCodecs(int* failures) {
+    unsigned long long varints[] = {0, 1, 127, 128, 300, 1ULL << 35, ~0ULL};
+    long long signedValues[] = {0, -1, 1, -123456789, 0x7fffffffffffffffLL, -0x7fffffffffffffffLL - 1};
+    char* dates[] = {"2025-03-28", "1970-01-01", "2025-3-8", ""};
+    char* times[] = {"09:30", "00:00", "23:59", "9:30", ""};
+    float amounts[] = {0.0f, 200.0f, 212.5f, -5.25f, 0.1f, 1e9f};
+    struct TableFile f;
+    struct ByteReader r;
+    char text[DATE_LEN];
+    int ok;
+
+    initTableFile(&f, "self test");
+    for (int i = 0; i < (int)(sizeof(varints) / sizeof(varints[0])); i++) putVarint(&f, varints[i]);
+    for (int i = 0; i < (int)(sizeof(signedValues) / sizeof(signedValues[0])); i++) putVarint(&f, zigzag(signedValues[i]));
+    for (int i = 0; i < (int)(sizeof(dates) / sizeof(dates[0])); i++) putArchiveDate(&f, dates[i]);
+    for (int i = 0; i < (int)(sizeof(times) / sizeof(times[0])); i++) putArchiveTime(&f, times[i]);
+    for (int i = 0; i < (int)(sizeof(amounts) / sizeof(amounts[0])); i++) putArchiveAmount(&f, amounts[i]);
+    if (f.failed) {
+        selfCheck(failures, 0, "archive codecs (out of memory)");
+        freeTableFile(&f);
+        return;
+    }
+
+    r.data = f.data;
+    r.length = f.length;
+    r.position = 0;
+    r.bad = 0;
+    ok = 1;
+    for (int i = 0; i < (int)(sizeof(varints) / sizeof(varints[0])); i++) ok &= getVarint(&r) == varints[i];
+    selfCheck(failures, ok, "varints round-trip");
+    ok = 1;
+    for (int i = 0; i < (int)(sizeof(signedValues) / sizeof(signedValues[0])); i++) {
+        ok &= unzigzag(getVarint(&r)) == signedValues[i];
+    }
+    selfCheck(failures, ok, "zigzag round-trips");
+    ok = 1;
+    for (int i = 0; i < (int)(sizeof(dates) / sizeof(dates[0])); i++) {
+        getArchiveDate(&r, text);
+        ok &= strcmp(text, dates[i]) == 0;
+    }
+    selfCheck(failures, ok, "archive dates round-trip (canonical and as text)");
+    ok = 1;
+    for (int i = 0; i < (int)(sizeof(times) / sizeof(times[0])); i++) {
+        getArchiveTime(&r, text);
+        ok &= strcmp(text, times[i]) == 0;
+    }
+    selfCheck(failures, ok, "archive times round-trip (canonical and as text)");
+    ok = 1;
+    for (int i = 0; i < (int)(sizeof(amounts) / sizeof(amounts[0])); i++) ok &= getArchiveAmount(&r) == amounts[i];
+    selfCheck(failures, ok, "archive amounts round-trip (cents and raw bits)");
+    selfCheck(failures, !r.bad && r.position == r.length, "archive reader ends exactly at the end");
+    getVarint(&r);
+    selfCheck(failures, r.bad, "archive reader flags reads past the end");
+    freeTableFile(&f);
+
+    ok = 1;
+    for (int day = parseDate("1900-01-01"); day <= parseDate("2199-12-31"); day += 13) {
+        formatDate(day, text);
+        ok &= parseDate(text) == day;
+    }
+    selfCheck(failures, ok, "day numbers and dates convert both ways");
+
+    // Whole records, IDs delta-encoded against the previous one
+    struct Appointment appointments[3], appointmentsOut[3];
+    struct Bill bills[2], billsOut[2];
+    memset(appointments, 0, sizeof(appointments));
+    memset(bills, 0, sizeof(bills));
+    appointments[0] = (struct Appointment){7, 3, 1, "2025-03-28", "09:30"};
+    appointments[1] = (struct Appointment){8, 4, 2, "2025-3-8", ""};
+    appointments[2] = (struct Appointment){1000007, -1, 0, "", "23:30"};
+    bills[0] = (struct Bill){9, 3, 1, 200.0f, 212.5f, "2025-03-30"};
+    bills[1] = (struct Bill){12, 5, -1, 0.0f, 0.1f, "2024-02-29"};
+    initTableFile(&f, "self test");
+    for (int i = 0; i < 3; i++) encodeArchiveRecord(&f, TABLE_APPOINTMENT, appointments, i, i > 0 ? appointments[i - 1].id : 0);
+    for (int i = 0; i < 2; i++) encodeArchiveRecord(&f, TABLE_BILL, bills, i, i > 0 ? bills[i - 1].id : 0);
+    r.data = f.data;
+    r.length = f.length;
+    r.position = 0;
+    r.bad = 0;
+    int previousId = 0;
+    for (int i = 0; i < 3; i++) previousId = decodeArchiveRecord(&r, TABLE_APPOINTMENT, &appointmentsOut[i], previousId);
+    previousId = 0;
+    for (int i = 0; i < 2; i++) previousId = decodeArchiveRecord(&r, TABLE_BILL, &billsOut[i], previousId);
+    selfCheck(failures, !f.failed && !r.bad && memcmp(appointments, appointmentsOut, sizeof(appointments)) == 0
+                        && memcmp(bills, billsOut, sizeof(bills)) == 0,
+              "archived appointments and bills decode byte for byte");
+    freeTableFile(&f);
+}
+
+int compareDateEntryKeys(const void* a, const void* b) {
+    return compareDateKeys(&((const struct DateEntry*)a)->key, &((const struct DateEntry*)b)->key);
+}
+
+// Random bookings, moves and cancellations; after each batch, paged range
+// scans must return exactly what a scan of appointments[] finds
+void selfTestDateIndex(int* failures) {
+    struct AppState* state = createSelfTestState();
+    struct DateEntry expected[MAX_APPOINTMENTS], found[MAX_APPOINTMENTS];
+    int firstDay = parseDate("2025-01-01");
+    int nextId = 1, scans = 0, ok = 1, maxNodes = 0;
+    if (state == NULL) {
+        selfCheck(failures, 0, "date index (out of memory)");
+        return;
+    }
+    srand(1);
+    for (int op = 0; op < 4000 && ok; op++) {
+        struct Appointment appt;
+        memset(&appt, 0, sizeof(appt));
+        appt.patientId = rand() % 50 + 1;
+        appt.doctorId = rand() % 5 + 1;
+        formatDate(firstDay + rand() % 60, appt.date);
+        formatTime(rand() % 48 * 30, appt.time);
+        if (rand() % 20 == 0) appt.time[0] = '\0';
+        if (rand() % 50 == 0) snprintf(appt.date, DATE_LEN, "unknown");
+        int r = rand() % 10;
+        if (state->appointmentCount == 0 || (r < 5 && state->appointmentCount < MAX_APPOINTMENTS)) {
+            appt.id = nextId++;
+            insertAppointmentRecord(state, &appt);
+        } else if (r < 7) {
+            int i = rand() % state->appointmentCount;
+            appt.id = state->appointments[i].id;
+            updateAppointmentRecord(state, i, &appt);
+        } else {
+            removeAppointmentAt(state, rand() % state->appointmentCount);
+        }
+        if (state->dateIndex.nodeCount > maxNodes) maxNodes = state->dateIndex.nodeCount;
+        if (op % 25 != 0) continue;
+
+        int first = firstDay + rand() % 60 - 3, lastDay = first + rand() % 10;
+        int doctorId = rand() % 3 == 0 ? 0 : rand() % 5 + 1;
+        int expectedCount = 0, foundCount = 0, pageSize = rand() % 7 + 1, count;
+        for (int i = 0; i < state->appointmentCount; i++) {
+            struct DateKey key;
+            if (dateKeyOf(&state->appointments[i], &key) != 0 || key.day < first || key.day > lastDay) continue;
+            if (doctorId != 0 && key.doctorId != doctorId) continue;
+            expected[expectedCount].key = key;
+            expected[expectedCount].patientId = state->appointments[i].patientId;
+            expectedCount++;
+        }
+        qsort(expected, expectedCount, sizeof(struct DateEntry), compareDateEntryKeys);
+        struct DateKey cursor = {first - 1, 24 * 60, 0, 0};
+        while ((count = scanDateIndex(&state->dateIndex, &cursor, lastDay, doctorId, found + foundCount, pageSize)) > 0) {
+            foundCount += count;
+            cursor = found[foundCount - 1].key;
+        }
+        ok = foundCount == expectedCount;
+        for (int i = 0; i < expectedCount && ok; i++) {
+            ok = compareDateKeys(&expected[i].key, &found[i].key) == 0 && expected[i].patientId == found[i].patientId;
+        }
+        scans++;
+    }
+    selfCheck(failures, ok && scans > 0, "date index range scans match a full scan through inserts, moves and cancellations");
+    selfCheck(failures, maxNodes > DATE_INDEX_FANOUT, "date index grew past one level of nodes (splits were exercised)");
+    freeSelfTestState(state);
+}
+
+// Exact names are found at distance 0, one typo at distance 1, and removed
+// patients are not found
+void selfTestNameIndex(int* failures) {
+    char* first[] = {"Amina", "Rajan", "Shahid", "Priya", "Joseph", "Fatima", "Carlos", "Mei", "Olga", "Tariq"};
+    char* last[] = {"Yadav", "Khan", "Sharma", "Garcia", "Chen", "Ivanova", "Okafor", "Smith", "Haddad", "Lopez"};
+    struct AppState* state = createSelfTestState();
+    struct NameMatch matches[NAME_SEARCH_RESULTS];
+    int exact = 1, typo = 1, removed = 1;
+    if (state == NULL) {
+        selfCheck(failures, 0, "name index (out of memory)");
+        return;
+    }
+    for (int i = 0; i < MAX_PATIENTS; i++) {
+        struct Patient p;
+        memset(&p, 0, sizeof(p));
+        p.id = i + 1;
+        snprintf(p.name, NAME_LEN, "%s %s", first[i % 10], last[i / 10]);
+        insertPatientRecord(state, &p);
+    }
+    for (int i = 0; i < state->patientCount; i++) {
+        struct Patient* p = &state->patients[i];
+        char misspelt[NAME_LEN];
+        int count = searchPatientsByName(state, p->name, matches, NAME_SEARCH_RESULTS);
+        exact &= count > 0 && matches[0].patientId == p->id && matches[0].distance == 0;
+        snprintf(misspelt, NAME_LEN, "%s", p->name);
+        misspelt[1] = misspelt[1] == 'x' ? 'y' : 'x';
+        count = searchPatientsByName(state, misspelt, matches, NAME_SEARCH_RESULTS);
+        int seen = 0;
+        for (int m = 0; m < count; m++) seen |= matches[m].patientId == p->id && matches[m].distance <= 1;
+        typo &= seen;
+    }
+    selfCheck(failures, exact, "name index finds every patient by exact name");
+    selfCheck(failures, typo, "name index finds every patient with one typo");
+    for (int i = state->patientCount - 1; i >= 0; i -= 2) {
+        char name[NAME_LEN];
+        int id = state->patients[i].id;
+        snprintf(name, NAME_LEN, "%s", state->patients[i].name);
+        removePatientAt(state, i);
+        int count = searchPatientsByName(state, name, matches, NAME_SEARCH_RESULTS);
+        for (int m = 0; m < count; m++) removed &= matches[m].patientId != id;
+    }
+    selfCheck(failures, removed, "name index forgets removed patients");
+    freeSelfTestState(state);
+}
+
+// Queue changes keep every heap ordered and the waiting index in step; calls
+// come out most urgent first, then by arrival
+void selfTestTriage(int* failures) {
+    struct AppState* state = createSelfTestState();
+    struct TriageEvent event;
+    long long sequence = 0;
+    int ordered = 1, indexed = 1, calledInOrder = 1;
+    if (state == NULL) {
+        selfCheck(failures, 0, "triage queues (out of memory)");
+        return;
+    }
+    struct Doctor doctor;
+    memset(&doctor, 0, sizeof(doctor));
+    doctor.id = 1;
+    insertDoctorRecord(state, &doctor, NULL);
+    for (int i = 0; i < MAX_PATIENTS; i++) {
+        struct Patient p;
+        memset(&p, 0, sizeof(p));
+        p.id = i + 1;
+        snprintf(p.name, NAME_LEN, "Walk-in %d", i + 1);
+        insertPatientRecord(state, &p);
+    }
+
+    srand(2);
+    for (int op = 0; op < 2000; op++) {
+        memset(&event, 0, sizeof(event));
+        event.patientId = rand() % MAX_PATIENTS + 1;
+        event.doctorId = 1;
+        event.level = rand() % TRIAGE_LEVEL_LOWEST + 1;
+        event.sequence = ++sequence;
+        int r = rand() % 10;
+        event.op = r < 6 ? TRIAGE_ENQUEUE : r < 8 ? TRIAGE_REPRIORITIZE : TRIAGE_LEFT;
+        applyTriageEvent(state, &event); // Events that do not apply are refused
+        struct TriageQueue* queue = &state->triage[0];
+        for (int pos = 0; pos < queue->size; pos++) {
+            struct WaitingSlot* slot = findWaiting(state, queue->heap[pos].patientId);
+            indexed &= slot != NULL && slot->doctorIndex == 0 && slot->position == pos;
+            if (pos > 0) ordered &= !triageBefore(&queue->heap[pos], &queue->heap[(pos - 1) / TRIAGE_HEAP_ARITY]);
+        }
+    }
+    struct TriageEntry previous = {0, 0, 0, 0};
+    while (state->triage[0].size > 0) {
+        struct TriageEntry next = state->triage[0].heap[0];
+        if (previous.patientId != 0) calledInOrder &= !triageBefore(&next, &previous);
+        memset(&event, 0, sizeof(event));
+        event.op = TRIAGE_CALLED;
+        event.patientId = next.patientId;
+        event.sequence = ++sequence;
+        applyTriageEvent(state, &event);
+        previous = next;
+    }
+    selfCheck(failures, ordered, "triage heaps stay ordered through joins, re-triage and leaving");
+    selfCheck(failures, indexed, "waiting index tracks every heap position");
+    selfCheck(failures, calledInOrder, "patients are called most urgent first, then by arrival");
+    freeSelfTestState(state);
+}
+
+// Changes made on one state and replayed from its change log onto an empty
+// one must leave the same tables
+void selfTestChangeLog(int* failures) {
+    struct AppState* primary = createSelfTestState();
+    struct AppState* replica = createSelfTestState();
+    struct ChangeRecord record;
+    int applied = 0, valid = 1;
+    if (primary == NULL || replica == NULL) {
+        selfCheck(failures, 0, "change log replay (out of memory)");
+        freeSelfTestState(primary);
+        freeSelfTestState(replica);
+        return;
+    }
+    primary->changeLog = tmpfile();
+    if (primary->changeLog == NULL) {
+        printf("skip change log replay (no temporary file)\n");
+        freeSelfTestState(primary);
+        freeSelfTestState(replica);
+        return;
+    }
+
+    struct Doctor doctor;
+    memset(&doctor, 0, sizeof(doctor));
+    doctor.id = primary->nextDoctorId++;
+    snprintf(doctor.name, NAME_LEN, "Replay");
+    insertDoctorRecord(primary, &doctor, NULL);
+    srand(3);
+    for (int op = 0; op < 3000; op++) {
+        int r = rand() % 12;
+        if (r < 2 && primary->patientCount < MAX_PATIENTS) {
+            struct Patient p;
+            memset(&p, 0, sizeof(p));
+            p.id = primary->nextPatientId++;
+            snprintf(p.name, NAME_LEN, "Patient %d", p.id);
+            p.age = rand() % 90;
+            insertPatientRecord(primary, &p);
+        } else if (r < 3 && primary->patientCount > 0) {
+            int i = rand() % primary->patientCount;
+            struct Patient p = primary->patients[i];
+            p.age = rand() % 90;
+            updatePatientRecord(primary, i, &p);
+        } else if (r < 4 && primary->patientCount > 0) {
+            removePatientAt(primary, rand() % primary->patientCount);
+        } else if (r < 7 && primary->appointmentCount < MAX_APPOINTMENTS && primary->patientCount > 0) {
+            struct Appointment appt;
+            memset(&appt, 0, sizeof(appt));
+            appt.id = primary->nextAppointmentId++;
+            appt.patientId = primary->patients[rand() % primary->patientCount].id;
+            appt.doctorId = doctor.id;
+            formatDate(parseDate("2025-01-01") + rand() % 30, appt.date);
+            formatTime(rand() % 48 * 30, appt.time);
+            insertAppointmentRecord(primary, &appt);
+        } else if (r < 8 && primary->appointmentCount > 0) {
+            removeAppointmentAt(primary, rand() % primary->appointmentCount);
+        } else if (r < 10 && primary->billCount < MAX_BILLS && primary->patientCount > 0) {
+            struct Bill b;
+            memset(&b, 0, sizeof(b));
+            b.id = primary->nextBillId++;
+            b.patientId = primary->patients[rand() % primary->patientCount].id;
+            b.doctorId = doctor.id;
+            b.doctorFee = (float)(rand() % 500);
+            b.totalAmount = b.doctorFee;
+            formatDate(parseDate("2025-01-01") + rand() % 30, b.dateGenerated);
+            insertBillRecord(primary, &b);
+        } else if (r < 11 && primary->billCount > 0) {
+            int i = rand() % primary->billCount;
+            struct Bill b = primary->bills[i];
+            b.totalAmount += 10.0f;
+            updateBillRecord(primary, i, &b);
+        } else if (primary->billCount > 0) {
+            removeBillAt(primary, rand() % primary->billCount);
+        }
+    }
+
+    rewind(primary->changeLog);
+    while (fread(&record, sizeof(record), 1, primary->changeLog) == 1) {
+        valid &= isValidChangeRecord(&record);
+        applyChangeRecord(replica, &record);
+        applied++;
+    }
+    fclose(primary->changeLog);
+    primary->changeLog = NULL;
+
+    selfCheck(failures, valid && applied > 0 && replica->lastLsn == primary->lastLsn, "change log records are intact and in sequence");
+    selfCheck(failures, replica->patientCount == primary->patientCount && replica->doctorCount == primary->doctorCount
+                        && replica->appointmentCount == primary->appointmentCount && replica->billCount == primary->billCount
+                        && memcmp(replica->patients, primary->patients, primary->patientCount * sizeof(struct Patient)) == 0
+                        && memcmp(replica->appointments, primary->appointments, primary->appointmentCount * sizeof(struct Appointment)) == 0
+                        && memcmp(replica->bills, primary->bills, primary->billCount * sizeof(struct Bill)) == 0
+                        && replica->nextBillId == primary->nextBillId,
+              "replaying the change log rebuilds the same tables");
+
+    freeSelfTestState(primary);
+    freeSelfTestState(replica);
+}
+
+// A snapshot sees whole transactions only, keeps seeing the versions it
+// started with while they are replaced, and reads the same rows as the tables
+void selfTestSnapshots(int* failures) {
+    struct AppState* state = createSelfTestState();
+    struct Appointment appointments[2];
+    struct Bill readBills[2];
+    struct Snapshot before, during, after;
+    if (state == NULL) {
+        selfCheck(failures, 0, "snapshots (out of memory)");
+        return;
+    }
+    struct Patient p;
+    memset(&p, 0, sizeof(p));
+    p.id = state->nextPatientId++;
+    snprintf(p.name, NAME_LEN, "Snapshot");
+    insertPatientRecord(state, &p);
+    struct Doctor doctor;
+    memset(&doctor, 0, sizeof(doctor));
+    doctor.id = state->nextDoctorId++;
+    insertDoctorRecord(state, &doctor, NULL);
+
+    // The appointment and its bill go in as one transaction, as in
+    // scheduleAppointmentWithBill
+    struct Appointment appt;
+    struct Bill b;
+    memset(&appt, 0, sizeof(appt));
+    memset(&b, 0, sizeof(b));
+    appt.id = state->nextAppointmentId++;
+    appt.patientId = p.id;
+    appt.doctorId = doctor.id;
+    snprintf(appt.date, DATE_LEN, "2025-03-28");
+    snprintf(appt.time, TIME_LEN, "09:30");
+    b.id = state->nextBillId++;
+    b.patientId = p.id;
+    b.doctorId = doctor.id;
+    b.doctorFee = 50.0f;
+    b.totalAmount = 50.0f;
+    snprintf(b.dateGenerated, DATE_LEN, "2025-03-28");
+    int ok = openSnapshot(state, &before) == 0;
+    beginTransaction(state);
+    insertAppointmentRecord(state, &appt);
+    ok &= openSnapshot(state, &during) == 0;
+    insertBillRecord(state, &b);
+    commitTransaction(state);
+    ok &= openSnapshot(state, &after) == 0;
+    if (!ok) {
+        selfCheck(failures, 0, "snapshots (no free snapshot slot)");
+        freeSelfTestState(state);
+        return;
+    }
+    selfCheck(failures, readSnapshot(&before, TABLE_APPOINTMENT, appointments, sizeof(struct Appointment), 2) == 0
+                        && readSnapshot(&before, TABLE_BILL, readBills, sizeof(struct Bill), 2) == 0
+                        && readSnapshot(&during, TABLE_APPOINTMENT, appointments, sizeof(struct Appointment), 2) == 0
+                        && readSnapshot(&during, TABLE_BILL, readBills, sizeof(struct Bill), 2) == 0,
+              "a snapshot opened before or during a transaction sees none of it");
+    selfCheck(failures, readSnapshot(&after, TABLE_APPOINTMENT, appointments, sizeof(struct Appointment), 2) == 1
+                        && readSnapshot(&after, TABLE_BILL, readBills, sizeof(struct Bill), 2) == 1
+                        && memcmp(&appointments[0], &appt, sizeof(appt)) == 0 && memcmp(&readBills[0], &b, sizeof(b)) == 0,
+              "a snapshot opened after the commit sees the whole transaction");
+    closeSnapshot(&before);
+    closeSnapshot(&during);
+
+    // Replace the bill many times over (collections run every MVCC_GC_EVERY
+    // commits) while 'after' still reads the first version
+    for (int i = 0; i < 4 * MVCC_GC_EVERY; i++) {
+        struct Bill changed = state->bills[0];
+        changed.totalAmount += 10.0f;
+        updateBillRecord(state, 0, &changed);
+    }
+    collectVersions(state);
+    ok = readSnapshot(&after, TABLE_BILL, readBills, sizeof(struct Bill), 2) == 1 && readBills[0].totalAmount == b.totalAmount;
+    selfCheck(failures, ok, "collecting old versions keeps those an open snapshot can see");
+    int usedWhileOpen = state->billVersions.used;
+    closeSnapshot(&after);
+    collectVersions(state);
+    selfCheck(failures, state->billVersions.used == 1 && usedWhileOpen > 1,
+              "closing the snapshot lets its versions be collected");
+
+    // Snapshot reads go through the version stores, not the tables
+    srand(4);
+    for (int op = 0; op < 3000; op++) {
+        int r = rand() % 4;
+        if (r < 2 && state->billCount < MAX_BILLS) {
+            struct Bill added = b;
+            added.id = state->nextBillId++;
+            added.totalAmount = (float)(rand() % 500);
+            insertBillRecord(state, &added);
+        } else if (r < 3 && state->billCount > 0) {
+            int i = rand() % state->billCount;
+            struct Bill changed = state->bills[i];
+            changed.totalAmount += 10.0f;
+            updateBillRecord(state, i, &changed);
+        } else if (state->billCount > 0) {
+            removeBillAt(state, rand() % state->billCount);
+        }
+    }
+    struct Snapshot snap;
+    struct Bill* bills = malloc(MAX_BILLS * sizeof(struct Bill));
+    struct Bill* sorted = malloc(MAX_BILLS * sizeof(struct Bill));
+    ok = bills != NULL && sorted != NULL && openSnapshot(state, &snap) == 0;
+    if (ok) {
+        int count = readSnapshot(&snap, TABLE_BILL, bills, sizeof(struct Bill), MAX_BILLS);
+        closeSnapshot(&snap);
+        memcpy(sorted, state->bills, state->billCount * sizeof(struct Bill));
+        qsort(sorted, state->billCount, sizeof(struct Bill), compareLeadingIds);
+        ok = count == state->billCount && memcmp(bills, sorted, count * sizeof(struct Bill)) == 0;
+    }
+    selfCheck(failures, ok, "a snapshot reads the same bills as the table");
+    free(bills);
+    free(sorted);
+    freeSelfTestState(state);
+}
+
+int runSelfTest(void) {
+    int failures = 0;
+    selfTestCodecs(&failures);
+    selfTestDateIndex(&failures);
+    selfTestNameIndex(&failures);
+    selfTestTriage(&failures);
+    selfTestChangeLog(&failures);
+    selfTestSnapshots(&failures);
+    if (failures > 0) printf("%d check(s) failed.\n", failures);
+    else printf("All checks passed.\n");
+    return failures > 0 ? 1 : 0;
+}
 
-    // Initialize counts (important before loading)
-    appState.patientCount = 0;
-    appState.doctorCount = 0;
-    appState.appointmentCount = 0;
-    appState.billCount = 0;
-    // Initial ID values will be set by loadCounters
+// --- Main Function ---
+int main(int argc, char* argv[]) {
+    if (argc >= 2 && strcmp(argv[1], "--self-test") == 0) {
+        return runSelfTest();
+    }
+    if (argc >= 3 && strcmp(argv[1], "--replica") == 0) {
+        return runReplica(argv[2], argc >= 4 ? atoi(argv[3]) : 0);
+    }
+    if (argc >= 3 && strcmp(argv[1], "--cdc-consume") == 0) {
+        return consumeCdcEvents(argv[2], argc >= 4 ? atoi(argv[3]) : 0) == 0 ? 0 : 1;
+    }
 
-    loadData(&appState); // Load existing data into the state structure
+    // All branches (data partitions) managed by this process
+    struct Hospital hospital;
+    hospital.ioFlags = 0;
+    char* cdcSocket = NULL;
+    int publishChanges = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--direct-io") == 0) hospital.ioFlags |= IO_DIRECT;
+        else if (strcmp(argv[i], "--no-io-uring") == 0) hospital.ioFlags |= IO_NO_URING;
+        else if (strcmp(argv[i], "--cdc") == 0) publishChanges = 1;
+        else if (strcmp(argv[i], "--cdc-socket") == 0 && i + 1 < argc) {
+            cdcSocket = argv[++i];
+            publishChanges = 1;
+        }
+        else printf("Warning: Unknown option '%s' ignored.\n", argv[i]);
+    }
+    if (loadBranchConfig(&hospital) != 0) {
+        printf("Error: Not enough memory to start.\n");
+        return 1;
+    }
+    loadAllBranches(&hospital); // Load existing data of every branch in parallel
+    // Publish changes made from here on (only when asked: cdc.log keeps growing)
+    hospital.cdc = publishChanges ? startCdcStream(cdcSocket) : NULL;
+    for (int b = 0; b < hospital.branchCount; b++) {
+        hospital.branches[b]->cdc = hospital.cdc;
+    }
 
     int choice;
     while (1) {
-        printf("\n===== Hospital Management System =====\n");
+        // Menus below work on the current branch
+        struct AppState* appState = hospital.branches[hospital.current];
+
+        if (hospital.branchCount > 1) {
+            printf("\n===== Hospital Management System [%s] =====\n", appState->branchName);
+        } else {
+            printf("\n===== Hospital Management System =====\n");
+        }
         printf("1. Patient Management\n");
         printf("2. Doctor Management\n");
         printf("3. Appointment Management\n");
         printf("4. Billing System\n");
         printf("5. Save Data to Files\n");
+        printf("6. Branch Management\n");
+        printf("7. Dashboard\n");
+        printf("8. Waiting Room (Walk-ins)\n");
+        printf("9. Archive (Old Records)\n");
         printf("0. Exit\n");
         printf("======================================\n");
         choice = getIntInput("Enter your choice: ");
 
         switch (choice) {
-            // Pass the address of the state structure to menu functions
-            case 1: patientMenu(&appState); break;
-            case 2: doctorMenu(&appState); break;
-            case 3: appointmentMenu(&appState); break;
-            case 4: billingMenu(&appState); break;
-            case 5: saveData(&appState); break;
+            // Pass the current branch's state to menu functions
+            case 1: patientMenu(appState); break;
+            case 2: doctorMenu(appState); break;
+            case 3: appointmentMenu(appState); break;
+            case 4: billingMenu(appState); break;
+            case 5: saveAllBranches(&hospital); break;
+            case 6: branchMenu(&hospital); break;
+            case 7: dashboardMenu(appState); break;
+            case 8: waitingRoomMenu(appState); break;
+            case 9: archiveMenu(appState); break;
             case 0:
                 printf("Exiting program. Do you want to save data first? (yes/no): ");
                 char saveChoice[5];
                 getStringInput("", saveChoice, sizeof(saveChoice)); // Blank prompt
                 if (strcmp(saveChoice, "yes") == 0) {
-                    saveData(&appState);
+                    saveAllBranches(&hospital);
                 }
+                stopCdcStream(hospital.cdc); // Flush events still in the ring
+                freeBranches(&hospital);
                 printf("Goodbye!\n");
                 return 0; // Exit program
             default:
@@ -953,4 +7386,4 @@ int main() {
     }
 
     return 0; // Should not reach here
-}
\ No newline at end of file
+}